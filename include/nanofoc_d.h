@@ -75,7 +75,12 @@
 #define NANO_MODE 1
 #define NANO_MIDI 0
 #define NANO_PWM_FREQ 0
-#define NANO_LOOP_FREQ 0
+#define NANO_LOOP_FREQ 0 // FOC loop rate in Hz paced by a hardware timer (e.g. 10000, 20000, 40000), 0 = free-running
+#define NANO_HOUSEKEEPING_FREQ 1000 // FOC thread queue and event handling rate in Hz when NANO_LOOP_FREQ is set
+#define NANO_ENCODER_DMA 0 // 1 = pipelined sensor reads, the next SSI transfer runs while the FOC math for the current angle does
+#define NANO_ENCODER_SPI_FREQ 1000000 // SSI clock in Hz for the pipelined sensor reads
+#define NANO_ANGLE_PREDICTION 1 // 1 = the detents run on the angle extrapolated to when the output is applied, not the sampled one
+#define NANO_PWM_APPLY_DELAY_US 20 // from setting the duty cycles until the bridge applies them, about half a period at the default 25kHz PWM
 #define NANO_SPI0_FREQ 0
 #define NANO_SPI1_FREQ 0
 
@@ -0,0 +1,88 @@
+#include "knob_model.h"
+
+#define KNOB_SUBSTEPS 4
+
+/**
+ * Roughly a 2208 gimbal motor with a 30g aluminium knob, see the README for the reasoning.
+*/
+const KnobParams default_knob = {
+    .inertia = 4e-6,
+    .viscous_friction = 1e-5,
+    .coulomb_friction = 3e-4,
+    .torque_constant = 0.025,
+    .hand_stiffness = 0.2,
+    .hand_damping = 1.5e-3,
+    .hand_max_torque = 0.05
+};
+
+static double sim_time = 0.0;
+
+unsigned long micros(){
+    return (unsigned long)(sim_time * 1e6);
+}
+
+unsigned long millis(){
+    return (unsigned long)(sim_time * 1e3);
+}
+
+void sim_reset_clock(void){
+    sim_time = 0.0;
+}
+
+KnobModel::KnobModel(BLDCMotor* _motor, KnobParams _params){
+    motor = _motor;
+    params = _params;
+};
+
+void KnobModel::grab(void){
+    finger_angle = angle;
+    finger_velocity = 0.0;
+    touching = true;
+}
+
+void KnobModel::release(void){
+    touching = false;
+}
+
+void KnobModel::move_finger(float _angle, float _velocity){
+    finger_angle = _angle;
+    finger_velocity = _velocity;
+}
+
+/**
+ * Advances the simulated clock by dt (one FOC loop period) and integrates the knob,
+ * holding the motor torque constant over the period, like the real loop does.
+*/
+void KnobModel::step(float dt){
+    float h = dt / KNOB_SUBSTEPS;
+    float motor_torque = motor->target * params.torque_constant * motor->sensor_direction;
+
+    for(int i = 0; i < KNOB_SUBSTEPS; i++){
+        float drive = motor_torque;
+        if(touching){
+            float hand = params.hand_stiffness * (finger_angle - angle) + params.hand_damping * (finger_velocity - velocity);
+            drive += _constrain(hand, -params.hand_max_torque, params.hand_max_torque);
+        }
+        finger_angle += finger_velocity * h;
+
+        // Stiction, the knob stays put until the drive breaks it loose
+        if(fabsf(velocity) < 1e-3f && fabsf(drive) <= params.coulomb_friction){
+            velocity = 0.0;
+            continue;
+        }
+
+        float direction = velocity != 0.0f ? (velocity > 0 ? 1.0f : -1.0f) : (drive > 0 ? 1.0f : -1.0f);
+        float accel = (drive - direction * params.coulomb_friction - params.viscous_friction * velocity) / params.inertia;
+        float new_velocity = velocity + accel * h;
+        // Friction can stop the knob, but never reverse it
+        if(velocity != 0.0f && (new_velocity > 0) != (velocity > 0) && fabsf(drive) <= params.coulomb_friction)
+            new_velocity = 0.0;
+        velocity = new_velocity;
+        angle += velocity * h;
+    }
+
+    sim_time += dt;
+    motor->sensor_angle = angle;
+    motor->sensor_velocity = velocity;
+    motor->velocity_ts = dt;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <SimpleFOC.h>
+
+/**
+ * Mechanical model of the knob: rotor and knob inertia with viscous and coulomb friction,
+ * driven by the motor torque and optionally by a finger, modelled as a spring-damper
+ * between the finger angle and the knob.
+*/
+typedef struct {
+    float inertia;          // kg m^2, rotor plus knob
+    float viscous_friction; // Nm per rad/s
+    float coulomb_friction; // Nm, also the breakaway torque
+    float torque_constant;  // Nm per unit of motor target (A in estimated current mode)
+    float hand_stiffness;   // Nm per rad between finger and knob
+    float hand_damping;     // Nm per rad/s
+    float hand_max_torque;  // Nm, the finger slips beyond this
+} KnobParams;
+
+extern const KnobParams default_knob;
+
+class KnobModel
+{
+public:
+    KnobModel(BLDCMotor* _motor, KnobParams _params = default_knob);
+
+    void step(float dt);
+    void grab(void);
+    void release(void);
+    void move_finger(float angle, float velocity);
+
+    float angle = 0.0;
+    float velocity = 0.0;
+    float finger_angle = 0.0;
+    float finger_velocity = 0.0;
+    bool touching = false;
+
+private:
+    BLDCMotor* motor;
+    KnobParams params;
+};
+
+// Simulated clock, advanced by KnobModel::step()
+void sim_reset_clock(void);
@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+#include "haptic.h"
+#include "knob_model.h"
+
+/*
+    Native knob simulator
+
+    Runs the haptic module from src/haptic.cpp against the KnobModel and a set of scripted
+    turn gestures, reports detent accuracy, overshoot, settle time, endstop bounce and how fast
+    haptic_loop() runs on the host. Exits non-zero when a scenario ends on the wrong position,
+    so it can gate loop changes before they get flashed.
+*/
+
+#define SIM_LOOP_FREQ 10000         // Hz, matches NANO_LOOP_FREQ on the device
+#define SIM_SETTLE_BAND 0.02        // Settled within this fraction of a detent width..
+#define SIM_SETTLE_VELOCITY 0.5     // ..and below this velocity (rad/s)
+#define SIM_PREDICT_LEAD 50e-6      // s, the torque is held over the next period, so it applies half a period after the sample on average
+
+// Positions count up while the physical knob angle goes down with the production PCB wiring, see detent_handler()
+#define POS_TO_PHYSICAL -1.0
+
+/**
+ * One step of a gesture. The finger moves by the given number of detents over the duration,
+ * or lets go of the knob for the duration if release is set.
+*/
+typedef struct {
+    float detents;
+    uint32_t duration_ms;
+    bool release;
+} GestureStep;
+
+typedef struct {
+    const char* name;
+    DetentProfile profile;
+    int32_t start_pos;
+    std::vector<GestureStep> gesture;
+    int32_t expected_pos;
+    uint16_t tolerance;
+    const DetentProfile* switch_to = nullptr; // switched to at the start of the last step, expected_pos is in its range
+    float predict_lead = 0.0; // s, the angle prediction is off without one
+} Scenario;
+
+typedef struct {
+    int32_t final_pos;
+    int32_t rest_pos;       // detent the knob physically rests on at the end
+    uint32_t increments;
+    uint32_t decrements;
+    uint32_t limit_events;  // entries into an endstop, not the LIMIT callbacks fired every iteration past it
+    bool at_limit;
+    float overshoot;        // % of detent width past the resting angle, after the last release
+    float settle_ms;        // after the last release
+    uint32_t bounces;       // crossings of the resting angle, after the last release
+    float prediction_error;     // mrad, mean absolute error of the extrapolated angle once its lead has passed
+    float prediction_baseline;  // mrad, the same without extrapolating
+    uint64_t iterations;
+    double loop_seconds;    // wall time spent inside haptic_loop()
+} ScenarioResult;
+
+static ScenarioResult* current_result = nullptr;
+
+/**
+ * Replaces the firmware callback (src/foc_thread.cpp), counting the events instead of pushing them into the
+ * ring the HMI thread hands to its listeners.
+*/
+void HapticInterface::UserHapticEventCallback(HapticEvt event, float currentAngle, int32_t currentPos){
+    if(current_result == nullptr)
+        return;
+
+    switch(event){
+        case HapticEvt::INCREASE:
+            current_result->increments++;
+            current_result->at_limit = false;
+            break;
+        case HapticEvt::DECREASE:
+            current_result->decrements++;
+            current_result->at_limit = false;
+            break;
+        case HapticEvt::LIMIT_POS:
+        case HapticEvt::LIMIT_NEG:
+            if(!current_result->at_limit)
+                current_result->limit_events++;
+            current_result->at_limit = true;
+            break;
+        default:
+            break;
+    }
+}
+
+static DetentProfile make_profile(HapticMode mode, uint16_t start_pos, uint16_t end_pos, uint16_t detent_count,
+    uint8_t vernier = 1, bool kxForce = false, uint16_t spring_center = 0, bool endless = false)
+{
+    return DetentProfile{
+        .mode = mode,
+        .start_pos = start_pos,
+        .end_pos = end_pos,
+        .detent_count = detent_count,
+        .vernier = vernier,
+        .kxForce = kxForce,
+        .output_ramp = 10000,
+        .detent_strength = 3,
+        .spring_center = spring_center,
+        .endless = endless
+    };
+}
+
+static ScenarioResult run_scenario(const Scenario& scenario){
+    ScenarioResult result = {};
+    current_result = &result;
+
+    sim_reset_clock();
+
+    BLDCMotor motor(7, 5.3);
+    motor.sensor_direction = Direction::CW;
+    KnobModel knob(&motor);
+
+    HapticInterface haptic(&motor);
+    HapticState state(scenario.profile, scenario.start_pos);
+    haptic.haptic_state = &state;
+    haptic.init();
+    haptic.predict_lead = scenario.predict_lead;
+    motor.move(0);
+    motor.sensor_offset = motor.shaft_angle;
+
+    const float dt = 1.0 / SIM_LOOP_FREQ;
+    float width = state.detent_width;
+    // Detent the rest position is counted from
+    int32_t origin_pos = scenario.start_pos;
+    float origin_angle = 0.0;
+    HapticState next;
+    std::vector<float> angles;
+    std::vector<float> velocities;
+    uint32_t prediction_checks = haptic.prediction_checks;
+    uint32_t prediction_samples = 0;
+
+    for(size_t s = 0; s < scenario.gesture.size(); s++){
+        const GestureStep& step = scenario.gesture[s];
+        uint32_t iterations = step.duration_ms * SIM_LOOP_FREQ / 1000;
+        bool last = s == scenario.gesture.size() - 1;
+
+        if(step.release){
+            knob.release();
+        }
+        else{
+            if(!knob.touching)
+                knob.grab();
+            float velocity = step.detents * width * POS_TO_PHYSICAL / (step.duration_ms * 1e-3f);
+            knob.move_finger(knob.finger_angle, velocity);
+        }
+
+        if(last){
+            angles.clear();
+            velocities.clear();
+
+            if(scenario.switch_to != nullptr){
+                next.load_profile(*scenario.switch_to, scenario.switch_to->start_pos);
+                haptic.capture_state();
+                haptic.switch_state(&next);
+                width = next.detent_width;
+                origin_pos = next.current_pos;
+                origin_angle = knob.angle + next.attract_angle - motor.shaft_angle;
+            }
+        }
+
+        for(uint32_t i = 0; i < iterations; i++){
+            knob.step(dt);
+
+            auto t0 = std::chrono::steady_clock::now();
+            haptic.haptic_loop();
+            auto t1 = std::chrono::steady_clock::now();
+            result.loop_seconds += std::chrono::duration<double>(t1 - t0).count();
+            result.iterations++;
+
+            if(haptic.prediction_checks != prediction_checks){
+                prediction_checks = haptic.prediction_checks;
+                prediction_samples++;
+                result.prediction_error += fabsf(haptic.prediction_error);
+                result.prediction_baseline += fabsf(haptic.prediction_baseline);
+            }
+
+            if(last){
+                angles.push_back(knob.angle);
+                velocities.push_back(knob.velocity);
+            }
+        }
+
+        // Finger stops at the end of the step
+        knob.move_finger(knob.finger_angle, 0.0);
+    }
+
+    if(prediction_samples > 0){
+        result.prediction_error *= 1000.0f / prediction_samples;
+        result.prediction_baseline *= 1000.0f / prediction_samples;
+    }
+
+    result.final_pos = haptic.haptic_state->current_pos;
+    result.rest_pos = origin_pos + lroundf((knob.angle - origin_angle) / width * POS_TO_PHYSICAL);
+
+    // Settling analysis after the final step
+    if(!angles.empty()){
+        float rest = angles.back();
+        float approach = rest - angles.front() >= 0 ? 1.0 : -1.0;
+        float band = SIM_SETTLE_BAND * width;
+        int side = 0;
+        size_t settled = 0;
+
+        for(size_t i = 0; i < angles.size(); i++){
+            float offset = angles[i] - rest;
+            result.overshoot = max(result.overshoot, offset * approach / width * 100.0f);
+
+            if(fabsf(offset) > band || fabsf(velocities[i]) > SIM_SETTLE_VELOCITY)
+                settled = i + 1;
+
+            // Count crossings of the resting angle, with the settle band as hysteresis
+            if(fabsf(offset) > band){
+                int new_side = offset > 0 ? 1 : -1;
+                if(side != 0 && new_side != side)
+                    result.bounces++;
+                side = new_side;
+            }
+        }
+        result.settle_ms = settled * 1000.0f / SIM_LOOP_FREQ;
+    }
+
+    current_result = nullptr;
+    return result;
+}
+
+int main(int argc, char** argv){
+    DetentProfile coarse = make_profile(HapticMode::REGULAR, 0, 10, 20);
+    DetentProfile fine = make_profile(HapticMode::REGULAR, 0, 127, 127, 5, true);
+    DetentProfile vernier = make_profile(HapticMode::VERNIER, 0, 20, 20, 5, true);
+    DetentProfile viscose = make_profile(HapticMode::VISCOSE, 0, 127, 127);
+    DetentProfile spring = make_profile(HapticMode::SPRING, 0, 40, 40, 1, false, 20);
+    DetentProfile endless = make_profile(HapticMode::REGULAR, 0, 10, 20, 1, false, 0, true);
+    // Plain detent drawn as a curve, pulls towards the center from either side
+    DetentProfile curve = make_profile(HapticMode::CURVE, 0, 40, 20);
+    const int8_t detent_curve[][2] = { {-127, 0}, {-64, 127}, {0, 0}, {64, -127}, {127, 0} };
+    curve.curve_points = 5;
+    memcpy(curve.curve, detent_curve, sizeof(detent_curve));
+    // Detents fade out from 5 rad/s, down to 20% at 20 rad/s
+    DetentProfile glide = fine;
+    glide.glide_start = 5;
+    glide.glide_end = 20;
+    glide.glide_floor = 0.2;
+    // Profile switches, fading over 100ms
+    DetentProfile fine_fade = fine;
+    fine_fade.crossfade = 100;
+    DetentProfile coarse_fade = coarse;
+    coarse_fade.crossfade = 100;
+
+    std::vector<Scenario> scenarios = {
+        { "coarse slow turn +5", coarse, 0, { {5, 1000}, {0, 500, true} }, 5, 0 },
+        { "coarse flick +5", coarse, 0, { {5, 100}, {0, 500, true} }, 5, 0 },
+        { "coarse back and forth", coarse, 5, { {3, 600}, {-5, 800}, {0, 500, true} }, 3, 0 },
+        { "coarse push past end", coarse, 8, { {3, 600}, {0, 300}, {0, 500, true} }, 10, 0 },
+        { "coarse end and back -4", coarse, 8, { {3, 600}, {-4, 800}, {0, 500, true} }, 7, 0 },
+        { "coarse push past start", coarse, 2, { {-3, 600}, {0, 300}, {0, 500, true} }, 0, 0 },
+        { "coarse hard endstop", coarse, 8, { {5, 600}, {0, 300}, {0, 500, true} }, 10, 0 },
+        { "fine slow turn +20", fine, 60, { {20, 1000}, {0, 500, true} }, 80, 0 },
+        { "fine fast turn -40", fine, 60, { {-40, 300}, {0, 200}, {0, 500, true} }, 20, 0 },
+        { "glide fast turn -40", glide, 60, { {-40, 300}, {0, 200}, {0, 500, true} }, 20, 0 },
+        { "vernier turn +12", vernier, 50, { {12, 800}, {0, 500, true} }, 62, 0 },
+        { "viscose turn +10", viscose, 60, { {10, 500}, {0, 500, true} }, 70, 1 },
+        { "spring return", spring, 20, { {8, 400}, {0, 1000, true} }, 20, 0 },
+        { "curve turn +5", curve, 10, { {5, 1000}, {0, 500, true} }, 15, 0 },
+        { "endless past start -5", endless, 2, { {-5, 600}, {0, 500, true} }, -3, 0 },
+        { "endless past 16 bit", endless, 65533, { {5, 600}, {0, 500, true} }, 65538, 0 },
+        { "switch coarse to fine", coarse, 5, { {2, 600}, {0, 200, true}, {0, 500, true} }, 88, 0, &fine_fade },
+        { "switch fine to coarse", fine, 60, { {10, 600}, {0, 200, true}, {0, 500, true} }, 5, 0, &coarse_fade },
+        // The same gestures with the detents running on the predicted angle
+        { "coarse flick +5 lead", coarse, 0, { {5, 100}, {0, 500, true} }, 5, 0, nullptr, SIM_PREDICT_LEAD },
+        { "coarse hard endstop lead", coarse, 8, { {5, 600}, {0, 300}, {0, 500, true} }, 10, 0, nullptr, SIM_PREDICT_LEAD },
+        { "fine fast turn -40 lead", fine, 60, { {-40, 300}, {0, 200}, {0, 500, true} }, 20, 0, nullptr, SIM_PREDICT_LEAD },
+        { "spring return lead", spring, 20, { {8, 400}, {0, 1000, true} }, 20, 0, nullptr, SIM_PREDICT_LEAD },
+        { "switch fine to coarse lead", fine, 60, { {10, 600}, {0, 200, true}, {0, 500, true} }, 5, 0, &coarse_fade, SIM_PREDICT_LEAD },
+    };
+
+    int failures = 0;
+    uint64_t total_iterations = 0;
+    double total_seconds = 0.0;
+
+    printf("%-26s %6s %6s %6s %5s %5s %5s %11s %10s %8s %9s %9s %10s\n",
+        "scenario", "pos", "exp", "rest", "inc", "dec", "lim", "overshoot%", "settle_ms", "bounces", "pred_mrad", "base_mrad", "loops/s");
+
+    for(const Scenario& scenario : scenarios){
+        ScenarioResult r = run_scenario(scenario);
+        // The reported position has to match the gesture and where the knob actually ended up
+        bool ok = abs(r.final_pos - scenario.expected_pos) <= scenario.tolerance && r.final_pos == r.rest_pos;
+        if(!ok)
+            failures++;
+        total_iterations += r.iterations;
+        total_seconds += r.loop_seconds;
+
+        printf("%-26s %6d %6d %6d %5u %5u %5u %11.1f %10.1f %8u %9.3f %9.3f %10.0f %s\n",
+            scenario.name, r.final_pos, scenario.expected_pos, r.rest_pos, r.increments, r.decrements, r.limit_events,
+            r.overshoot, r.settle_ms, r.bounces, r.prediction_error, r.prediction_baseline, r.iterations / r.loop_seconds,
+            ok ? "" : "FAIL");
+    }
+
+    printf("\n%llu iterations, haptic_loop() %.0f loops/s, %d of %zu scenarios failed\n",
+        (unsigned long long)total_iterations, total_iterations / total_seconds, failures, scenarios.size());
+
+    return failures > 0 ? 1 : 0;
+}
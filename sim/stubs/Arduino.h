@@ -0,0 +1,20 @@
+#pragma once
+
+/*
+ * Minimal Arduino core for the native knob simulator.
+ * Time comes from the simulated clock, see sim/knob_model.cpp.
+ */
+
+#include <stdint.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+unsigned long micros();
+unsigned long millis();
+
+inline float radians(float deg) { return deg * 0.017453292519943f; }
+inline float degrees(float rad) { return rad * 57.295779513082f; }
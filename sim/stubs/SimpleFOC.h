@@ -0,0 +1,127 @@
+#pragma once
+
+/*
+ * SimpleFOC stand-in for the native knob simulator.
+ *
+ * PIDController follows SimpleFOC 2.3 so the haptic tuning carries over.
+ * BLDCMotor has no electrical model, the commanded torque target is picked up by
+ * the KnobModel, which in turn feeds the sensor angle back in.
+ */
+
+#include <Arduino.h>
+#include "common/foc_utils.h"
+
+enum Direction : int8_t {
+    CW = 1,
+    CCW = -1,
+    UNKNOWN = 0
+};
+
+enum MotionControlType : uint8_t {
+    torque,
+    velocity,
+    angle,
+    velocity_openloop,
+    angle_openloop
+};
+
+enum FOCModulationType : uint8_t {
+    SinePWM,
+    SpaceVectorPWM,
+    Trapezoid_120,
+    Trapezoid_150
+};
+
+class Sensor
+{
+public:
+    float getMechanicalAngle() { return mechanical_angle; }
+    float mechanical_angle = 0;
+};
+
+class PIDController
+{
+public:
+    PIDController(float P, float I, float D, float ramp, float limit)
+        : P(P), I(I), D(D), output_ramp(ramp), limit(limit) {}
+
+    float operator() (float error){
+        unsigned long timestamp_now = micros();
+        float Ts = (timestamp_now - timestamp_prev) * 1e-6f;
+        if(Ts <= 0 || Ts > 0.5f) Ts = 1e-3f;
+
+        float proportional = P * error;
+        float integral = integral_prev + I * Ts * 0.5f * (error + error_prev);
+        integral = _constrain(integral, -limit, limit);
+        float derivative = D * (error - error_prev) / Ts;
+
+        float output = proportional + integral + derivative;
+        output = _constrain(output, -limit, limit);
+
+        if(output_ramp > 0){
+            float output_rate = (output - output_prev) / Ts;
+            if(output_rate > output_ramp)
+                output = output_prev + output_ramp * Ts;
+            else if(output_rate < -output_ramp)
+                output = output_prev - output_ramp * Ts;
+        }
+
+        integral_prev = integral;
+        output_prev = output;
+        error_prev = error;
+        timestamp_prev = timestamp_now;
+        return output;
+    }
+
+    void reset(){
+        integral_prev = 0.0f;
+        output_prev = 0.0f;
+        error_prev = 0.0f;
+    }
+
+    float P;
+    float I;
+    float D;
+    float output_ramp;
+    float limit;
+
+protected:
+    float error_prev = 0.0f;
+    float output_prev = 0.0f;
+    float integral_prev = 0.0f;
+    unsigned long timestamp_prev = 0;
+};
+
+class BLDCMotor
+{
+public:
+    BLDCMotor(int pp, float R = NOT_SET) : pole_pairs(pp), phase_resistance(R) {}
+
+    void loopFOC() {}
+
+    // Same order as SimpleFOC: read the shaft, then latch the new target.
+    void move(float new_target){
+        shaft_angle = sensor_direction * sensor_angle - sensor_offset;
+        float alpha = velocity_tf / (velocity_tf + velocity_ts);
+        shaft_velocity = alpha * shaft_velocity + (1.0f - alpha) * sensor_direction * sensor_velocity;
+        target = new_target;
+    }
+
+    float shaft_angle = 0;
+    float shaft_velocity = 0;
+    float sensor_offset = 0;
+    float target = 0;
+    float velocity_limit = 0;
+    int pole_pairs;
+    float phase_resistance;
+    Direction sensor_direction = Direction::CW;
+    MotionControlType controller = MotionControlType::torque;
+    FOCModulationType foc_modulation = FOCModulationType::SinePWM;
+    Sensor* sensor = nullptr;
+
+    // Written by the KnobModel
+    float sensor_angle = 0;
+    float sensor_velocity = 0;
+    float velocity_ts = 1e-4f; // loop period, for the velocity low pass
+    float velocity_tf = 0.01f; // same as motor.LPF_velocity.Tf on the device
+};
@@ -0,0 +1,10 @@
+#pragma once
+
+// Subset of SimpleFOC common/foc_utils.h used by the haptic module
+
+#define _PI 3.14159265359f
+#define _2PI 6.28318530718f
+#define _PI_2 1.57079632679f
+#define NOT_SET -12345.0
+
+#define _constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
@@ -39,6 +39,8 @@ DeviceSettings::DeviceSettings() {
     wifiEnabled = false;
     midi_sysex_id = 0x00;
     idleTimeout = 10000;
+    eventMinAngle = 0.017453292519943f; // 1° in radians
+    eventMinInterval = 10000; // 100Hz
 };
 
 
@@ -96,6 +98,10 @@ DeviceSettings& DeviceSettings::operator=(JsonObject& obj){
         midi_sysex_id = obj["sysexId"].as<uint8_t>();
     if (obj["idleTimeout"].is<uint32_t>())
         idleTimeout = obj["idleTimeout"].as<uint32_t>();
+    if (obj["eventMinAngle"].is<float>())
+        eventMinAngle = obj["eventMinAngle"].as<float>();
+    if (obj["eventMinInterval"].is<uint32_t>())
+        eventMinInterval = obj["eventMinInterval"].as<uint32_t>();
     dirty = true;
     return *this;
 };
@@ -132,6 +138,8 @@ void DeviceSettings::toJSON(JsonObject& obj){
     midi2Obj["nano"] = midi2.nano;
     obj["sysexId"] = midi_sysex_id;
     obj["idleTimeout"] = idleTimeout;
+    obj["eventMinAngle"] = eventMinAngle;
+    obj["eventMinInterval"] = eventMinInterval;
 };
 
 
@@ -211,6 +219,55 @@ void DeviceSettings::storeCalibration(MotorCalibration& cal) {
 };
 
 
+void DeviceSettings::storeCalibration(AnticoggingTable& table) {
+    if (table.valid)
+        nano_preferences.putBytes("anticogging", &table, sizeof(AnticoggingTable));
+    else
+        nano_preferences.remove("anticogging");
+};
+
+
+void DeviceSettings::storeCalibration(EncoderCalibration& cal) {
+    if (cal.valid)
+        nano_preferences.putBytes("encoder_lut", &cal, sizeof(EncoderCalibration));
+    else
+        nano_preferences.remove("encoder_lut");
+};
+
+
+void DeviceSettings::storeCalibration(PidTuning& tuning) {
+    if (tuning.valid)
+        nano_preferences.putBytes("pid_tuning", &tuning, sizeof(PidTuning));
+    else
+        nano_preferences.remove("pid_tuning");
+};
+
+
+bool DeviceSettings::loadCalibration(PidTuning& tuning) {
+    if (nano_preferences.getBytesLength("pid_tuning") != sizeof(PidTuning))
+        return false;
+    nano_preferences.getBytes("pid_tuning", &tuning, sizeof(PidTuning));
+    return tuning.valid;
+};
+
+
+bool DeviceSettings::loadCalibration(EncoderCalibration& cal) {
+    if (nano_preferences.getBytesLength("encoder_lut") != sizeof(EncoderCalibration))
+        return false;
+    nano_preferences.getBytes("encoder_lut", &cal, sizeof(EncoderCalibration));
+    return cal.valid;
+};
+
+
+bool DeviceSettings::loadCalibration(AnticoggingTable& table) {
+    // a table stored with a different layout is ignored
+    if (nano_preferences.getBytesLength("anticogging") != sizeof(AnticoggingTable))
+        return false;
+    nano_preferences.getBytes("anticogging", &table, sizeof(AnticoggingTable));
+    return table.valid;
+};
+
+
 MotorCalibration DeviceSettings::loadCalibration() {
     MotorCalibration result;
     result.direction = nano_preferences.getUChar("direction", 0);
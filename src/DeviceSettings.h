@@ -4,6 +4,7 @@
 
 
 #include <ArduinoJSON.h>
+#include "haptic_api.h"
 
 
 typedef struct {
@@ -21,6 +22,18 @@ typedef struct {
 } MotorCalibration;
 
 
+#define ENCODER_LUT_SIZE 128 // power of two
+#define ENCODER_LUT_UNIT (6.283185307179586f / 65536) // rad per offset step
+
+/**
+ * Sensor linearization map, the error of the raw sensor angle indexed by the raw angle.
+ */
+typedef struct {
+    bool valid;
+    int16_t offset[ENCODER_LUT_SIZE];
+} EncoderCalibration;
+
+
 
 typedef struct {
     uint8_t ledMaxBrightness;
@@ -54,6 +67,12 @@ public:
     String loadCurrentProfile();
     MotorCalibration loadCalibration();
     void storeCalibration(MotorCalibration& cal);
+    bool loadCalibration(AnticoggingTable& table);
+    void storeCalibration(AnticoggingTable& table);
+    bool loadCalibration(EncoderCalibration& cal);
+    void storeCalibration(EncoderCalibration& cal);
+    bool loadCalibration(PidTuning& tuning);
+    void storeCalibration(PidTuning& tuning);
     bool init();
 
     bool dirty;
@@ -71,6 +90,8 @@ public:
     String wifiPassword;
     bool wifiEnabled;
     uint32_t idleTimeout;
+    float eventMinAngle;
+    uint32_t eventMinInterval;
 
     // read-only settings
     String serialNumber;
@@ -1,7 +1,8 @@
 
 #include "./HapticCommander.h"
+#include "./DeviceSettings.h"
 
-HapticCommander::HapticCommander(BLDCMotor* motor) : motor(motor) {};
+HapticCommander::HapticCommander(BLDCMotor* motor, HapticInterface* haptic, NanoEncoder* encoder) : motor(motor), haptic(haptic), encoder(encoder) {};
 
 void HapticCommander::handleMessage(String* message) {    
     msg_in = (char*)message->c_str();
@@ -19,6 +20,43 @@ void HapticCommander::handleMessage(String* message) {
                 motor->initFOC();
             }
         }
+        else if (reg==REG_ANTICOGGING && haptic!=nullptr) {
+            // 1 = sweep the rotor and build the table, 0 = clear it
+            uint8_t value; *this >> value;
+            if (value==1)
+                haptic->calibrate_anticogging();
+            else
+                haptic->anticogging.valid = false;
+            DeviceSettings::getInstance().storeCalibration(haptic->anticogging);
+        }
+        else if (reg==REG_AUTOTUNE && haptic!=nullptr) {
+            // 1 = step-response tune the PID for this unit, 0 = back to the default tuning
+            uint8_t value; *this >> value;
+            if (value==1)
+                haptic->autotune();
+            else
+                pid_tuning.write(PidTuning{ .valid = false });
+            PidTuning tuning = pid_tuning.read();
+            DeviceSettings::getInstance().storeCalibration(tuning);
+            // recompile the active profile's gains
+            HapticState* state = haptic->haptic_state;
+            state->load_profile(state->detent_profile, state->current_pos);
+        }
+        else if (reg==REG_LINEARIZE && encoder!=nullptr) {
+            // 1 = measure the sensor linearization map, 0 = clear it
+            uint8_t value; *this >> value;
+            EncoderCalibration& cal = encoder->getCalibration();
+            if (value==1)
+                encoder->calibrate(motor);
+            else
+                cal.valid = false;
+            DeviceSettings::getInstance().storeCalibration(cal);
+            // corrected angles move the electrical zero, so align the motor again
+            motor->zero_electric_angle = NOT_SET;
+            motor->initFOC();
+            MotorCalibration mcal = { motor->sensor_direction, motor->zero_electric_angle };
+            DeviceSettings::getInstance().storeCalibration(mcal);
+        }
         else
             SimpleFOCRegisters::regs->commsToRegister(*this, reg, motor);
     }
@@ -37,6 +75,15 @@ void HapticCommander::sendRegister(uint8_t reg) {
     if (reg==REG_RECALIBRATE) {
         msg_out->concat("0");
     }
+    else if (reg==REG_LINEARIZE) {
+        msg_out->concat((encoder!=nullptr && encoder->getCalibration().valid) ? "1" : "0");
+    }
+    else if (reg==REG_ANTICOGGING) {
+        msg_out->concat((haptic!=nullptr && haptic->anticogging.valid) ? "1" : "0");
+    }
+    else if (reg==REG_AUTOTUNE) {
+        msg_out->concat(pid_tuning.read().valid ? "1" : "0");
+    }
     else
         SimpleFOCRegisters::regs->registerToComms(*this, reg, motor);
 };
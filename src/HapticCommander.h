@@ -3,9 +3,14 @@
 
 #include "comms/SimpleFOCRegisters.h"
 #include "BLDCMotor.h"
+#include "haptic.h"
+#include "NanoEncoder.h"
 
 
 #define REG_RECALIBRATE 0x81
+#define REG_ANTICOGGING 0x82
+#define REG_LINEARIZE 0x83
+#define REG_AUTOTUNE 0x84
 
 
 
@@ -18,7 +23,7 @@
  */
 class HapticCommander : public RegisterIO {
 public:
-    HapticCommander(BLDCMotor* motor);
+    HapticCommander(BLDCMotor* motor, HapticInterface* haptic = nullptr, NanoEncoder* encoder = nullptr);
     virtual ~HapticCommander() = default;
 
     void handleMessage(String* message);
@@ -33,6 +38,8 @@ public:
 
 protected:
     BLDCMotor* motor;
+    HapticInterface* haptic;
+    NanoEncoder* encoder;
     char* msg_in;
     String* msg_out;
 };
@@ -247,6 +247,16 @@ void HapticProfileManager::fromSPIFFS() {
       profile->hmi_config.knob.values[0].haptic.output_ramp = 5000.0f;
       profile->hmi_config.knob.values[0].haptic.detent_strength = 3.0f;
       profile->hmi_config.knob.values[0].haptic.kxForce = true;
+      profile->hmi_config.knob.values[0].haptic.spring_center = 63;
+      profile->hmi_config.knob.values[0].haptic.endless = false;
+      profile->hmi_config.knob.values[0].haptic.limit_effect = HapticEffect::EFFECT_NONE;
+      profile->hmi_config.knob.values[0].haptic.curve_points = 0;
+      profile->hmi_config.knob.values[0].haptic.glide_start = 0;
+      profile->hmi_config.knob.values[0].haptic.glide_end = 0;
+      profile->hmi_config.knob.values[0].haptic.glide_floor = 0;
+      profile->hmi_config.knob.values[0].haptic.pid_p = 0;
+      profile->hmi_config.knob.values[0].haptic.pid_d = 0;
+      profile->hmi_config.knob.values[0].haptic.crossfade = 100;
       current_profile = profile;
     }
     else {
@@ -431,6 +441,33 @@ HapticProfile& HapticProfile::operator=(JsonObject& obj) {
           update_field(haptic, kxForce, hmi_config.knob.values[i].haptic.kxForce);
           update_field(haptic, outputRamp, hmi_config.knob.values[i].haptic.output_ramp);
           update_field(haptic, detentStrength, hmi_config.knob.values[i].haptic.detent_strength);
+          update_field(haptic, springCenter, hmi_config.knob.values[i].haptic.spring_center);
+          update_field(haptic, endless, hmi_config.knob.values[i].haptic.endless);
+          update_field(haptic, limitEffect, hmi_config.knob.values[i].haptic.limit_effect);
+          update_field(haptic, glideStart, hmi_config.knob.values[i].haptic.glide_start);
+          update_field(haptic, glideEnd, hmi_config.knob.values[i].haptic.glide_end);
+          update_field(haptic, glideFloor, hmi_config.knob.values[i].haptic.glide_floor);
+          update_field(haptic, pidP, hmi_config.knob.values[i].haptic.pid_p);
+          update_field(haptic, pidD, hmi_config.knob.values[i].haptic.pid_d);
+          update_field(haptic, crossfade, hmi_config.knob.values[i].haptic.crossfade);
+          if (haptic["curve"].is<JsonArray>()) {
+            // [[x, force], ...] with x in detent widths (-0.5..0.5) and force -1..1, stored as int8 sorted by x
+            JsonArray points = haptic["curve"].as<JsonArray>();
+            DetentProfile& h = hmi_config.knob.values[i].haptic;
+            h.curve_points = min((int)points.size(), CURVE_MAX_POINTS);
+            for (int k=0; k<h.curve_points; k++) {
+              int8_t x = (int8_t)roundf(_constrain(points[k][0].as<float>(), -0.5f, 0.5f) * 254);
+              int8_t f = (int8_t)roundf(_constrain(points[k][1].as<float>(), -1.0f, 1.0f) * 127);
+              int j = k;
+              for (; j>0 && h.curve[j-1][0]>x; j--) {
+                h.curve[j][0] = h.curve[j-1][0];
+                h.curve[j][1] = h.curve[j-1][1];
+              }
+              h.curve[j][0] = x;
+              h.curve[j][1] = f;
+            }
+            dirty = true;
+          }
         }
         String type = value["type"].as<String>();
         if (type=="midi") {
@@ -440,6 +477,7 @@ HapticProfile& HapticProfile::operator=(JsonObject& obj) {
         }
         else if (type=="mouse") {
           hmi_config.knob.values[i].type = knobValueType::KV_MOUSE;
+          update_field(value, axis, hmi_config.knob.values[i].mouse.axis);
           dirty = true;
         }
         else if (type=="gamepad") {
@@ -558,6 +596,21 @@ void HapticProfile::keyActionFromJSON(JsonObject& obj, keyAction& action) {
       action.type = keyActionType::KA_PROFILE_PREV;
       dirty = true;
     }
+    else if (type=="effect") {
+      action.type = keyActionType::KA_HAPTIC_EFFECT;
+      action.effect.effect = HapticEffect::EFFECT_CLICK;
+      action.effect.strength = 255;
+      update_field(obj, effect, action.effect.effect);
+      update_field(obj, strength, action.effect.strength);
+      dirty = true;
+    }
+    else if (type=="clip" && obj["name"].is<String>()) {
+      action.type = keyActionType::KA_HAPTIC_CLIP;
+      action.clip_name = obj["name"].as<String>();
+      action.clip.strength = 255;
+      update_field(obj, strength, action.clip.strength);
+      dirty = true;
+    }
     else {
       action.type = keyActionType::KA_NONE;
       dirty = true;
@@ -640,6 +693,23 @@ void HapticProfile::toJSON(JsonObject& doc){
     haptic["kxForce"] = hmi_config.knob.values[i].haptic.kxForce;
     haptic["outputRamp"] = hmi_config.knob.values[i].haptic.output_ramp;
     haptic["detentStrength"] = hmi_config.knob.values[i].haptic.detent_strength;
+    haptic["springCenter"] = hmi_config.knob.values[i].haptic.spring_center;
+    haptic["endless"] = hmi_config.knob.values[i].haptic.endless;
+    haptic["limitEffect"] = hmi_config.knob.values[i].haptic.limit_effect;
+    haptic["glideStart"] = hmi_config.knob.values[i].haptic.glide_start;
+    haptic["glideEnd"] = hmi_config.knob.values[i].haptic.glide_end;
+    haptic["glideFloor"] = hmi_config.knob.values[i].haptic.glide_floor;
+    haptic["pidP"] = hmi_config.knob.values[i].haptic.pid_p;
+    haptic["pidD"] = hmi_config.knob.values[i].haptic.pid_d;
+    haptic["crossfade"] = hmi_config.knob.values[i].haptic.crossfade;
+    if (hmi_config.knob.values[i].haptic.curve_points>0) {
+      JsonArray points = haptic["curve"].to<JsonArray>();
+      for (int k=0; k<hmi_config.knob.values[i].haptic.curve_points; k++) {
+        JsonArray point = points.add<JsonArray>();
+        point.add(hmi_config.knob.values[i].haptic.curve[k][0] / 254.0f);
+        point.add(hmi_config.knob.values[i].haptic.curve[k][1] / 127.0f);
+      }
+    }
     switch (hmi_config.knob.values[i].type) {
       case knobValueType::KV_MIDI:
         value["type"] = "midi";
@@ -721,6 +791,16 @@ void HapticProfile::keyActionToJSON(JsonObject& obj, keyAction& action){
     case keyActionType::KA_PROFILE_PREV:
       obj["type"] = "prev_profile";
       break;
+    case keyActionType::KA_HAPTIC_EFFECT:
+      obj["type"] = "effect";
+      obj["effect"] = action.effect.effect;
+      obj["strength"] = action.effect.strength;
+      break;
+    case keyActionType::KA_HAPTIC_CLIP:
+      obj["type"] = "clip";
+      obj["name"] = action.clip_name;
+      obj["strength"] = action.clip.strength;
+      break;
   }      
 };
 
@@ -0,0 +1,194 @@
+#include "./NanoEncoder.h"
+
+#define ENCODER_CAL_STEPS_PER_POLE 64
+#define ENCODER_CAL_SETTLE_MS 3
+#define ENCODER_DMA_HOST SPI3_HOST // HSPI
+#define ENCODER_DMA_MAX_AGE_US 500
+
+
+NanoEncoder::NanoEncoder(int nCS) : MagneticSensorMT6701SSI(nCS) {};
+
+
+float NanoEncoder::getSensorAngle() {
+    reads++;
+#if NANO_ENCODER_DMA
+    float angle = readPipelined();
+#else
+    sample_ts = micros();
+    float angle = MagneticSensorMT6701SSI::getSensorAngle();
+#endif
+    if (!calibration.valid)
+        return angle;
+
+    // interpolate between the two neighbouring table entries
+    float pos = angle * (ENCODER_LUT_SIZE / _2PI);
+    uint16_t i = (uint16_t)pos;
+    float frac = pos - i;
+    int16_t a = calibration.offset[i & (ENCODER_LUT_SIZE - 1)];
+    int16_t b = calibration.offset[(i + 1) & (ENCODER_LUT_SIZE - 1)];
+    angle -= (a + (b - a) * frac) * ENCODER_LUT_UNIT;
+
+    if (angle < 0)
+        angle += _2PI;
+    else if (angle >= _2PI)
+        angle -= _2PI;
+    return angle;
+};
+
+
+// the one bus read of a loop iteration
+void NanoEncoder::sample() {
+    MagneticSensorMT6701SSI::update();
+    // velocity is estimated against the time the angle was latched, not when it was picked up
+    angle_prev_ts = sample_ts;
+    age = micros() - sample_ts;
+    sampled = true;
+};
+
+
+#if NANO_ENCODER_DMA
+/**
+ * Sets up the sensor on the ESP-IDF SPI master and starts the first transfer, replaces init().
+ * SPI mode and frame match the SimpleFOCDrivers MT6701 SSI driver, readPipelined() decodes with its MT6701_DATA_POS.
+ */
+bool NanoEncoder::initDMA(int clk, int miso, int cs) {
+    spi_bus_config_t bus = {};
+    bus.sclk_io_num = clk;
+    bus.miso_io_num = miso;
+    bus.mosi_io_num = -1;
+    bus.quadwp_io_num = -1;
+    bus.quadhd_io_num = -1;
+    bus.max_transfer_sz = 4;
+    if (spi_bus_initialize(ENCODER_DMA_HOST, &bus, SPI_DMA_CH_AUTO) != ESP_OK)
+        return false;
+
+    spi_device_interface_config_t dev = {};
+    dev.clock_speed_hz = NANO_ENCODER_SPI_FREQ;
+    dev.mode = 2;
+    dev.spics_io_num = cs;
+    dev.queue_size = 1;
+    if (spi_bus_add_device(ENCODER_DMA_HOST, &dev, &dma_device) != ESP_OK)
+        return false;
+
+    memset(&dma_trans, 0, sizeof(dma_trans));
+    dma_trans.flags = SPI_TRANS_USE_RXDATA;
+    dma_trans.length = 24;
+    dma_trans.rxlength = 24;
+    dma_start = micros();
+    spi_device_queue_trans(dma_device, &dma_trans, portMAX_DELAY);
+
+    Sensor::init();
+    return true;
+};
+
+
+/**
+ * Collects the transfer started by the previous read and starts the next one right away.
+ * The angle was latched when its transfer started, which is recorded as the sample time.
+ */
+float NanoEncoder::readPipelined() {
+    spi_transaction_t* done;
+    spi_device_get_trans_result(dma_device, &done, portMAX_DELAY);
+
+    // the pending angle is too old to use, e.g. after a delay during alignment or calibration, get a fresh one
+    if (micros() - dma_start > ENCODER_DMA_MAX_AGE_US) {
+        dma_start = micros();
+        spi_device_queue_trans(dma_device, &dma_trans, portMAX_DELAY);
+        spi_device_get_trans_result(dma_device, &done, portMAX_DELAY);
+    }
+
+    // same frame decode as MagneticSensorMT6701SSI::readRawAngleSSI(), the angle starts MT6701_DATA_POS bits into the
+    // first 16 bits, the driver sets that per platform for where the SPI peripheral captures the first bit
+    uint16_t frame = (dma_trans.rx_data[0] << 8) | dma_trans.rx_data[1];
+    uint16_t raw = (frame >> MT6701_DATA_POS) & 0x3FFF;
+    sample_ts = dma_start;
+
+    dma_start = micros();
+    spi_device_queue_trans(dma_device, &dma_trans, portMAX_DELAY);
+
+    return raw / MT6701_CPR * _2PI;
+};
+#endif
+
+
+void NanoEncoder::update() {
+    // already sampled for this loop iteration
+    if (sampled) {
+        sampled = false;
+        return;
+    }
+    MagneticSensorMT6701SSI::update();
+};
+
+
+/**
+ * Steps the rotor open loop through every electrical revolution, forward and back, and records
+ * the deviation of the raw sensor angle from the commanded angle. The sensor direction must be known.
+ * Blocks for a few seconds, call from the FOC thread only. The motor needs re-aligning afterwards,
+ * as the corrected angles shift the electrical zero.
+ */
+bool NanoEncoder::calibrate(BLDCMotor* motor) {
+    if (motor->sensor_direction == Direction::UNKNOWN)
+        return false;
+
+    const int steps = motor->pole_pairs * ENCODER_CAL_STEPS_PER_POLE;
+    const float elec_step = _2PI / ENCODER_CAL_STEPS_PER_POLE;
+    float* sum = new float[ENCODER_LUT_SIZE]();
+    uint8_t* count = new uint8_t[ENCODER_LUT_SIZE]();
+
+    calibration.valid = false;
+    motor->setPhaseVoltage(motor->voltage_sensor_align, 0, 0);
+    delay(500);
+    float start = getSensorAngle();
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (int n = 0; n <= steps; n++) {
+            int k = pass == 0 ? n : steps - n;
+            motor->setPhaseVoltage(motor->voltage_sensor_align, 0, k * elec_step);
+            delay(ENCODER_CAL_SETTLE_MS);
+
+            float raw = getSensorAngle();
+            float expected = start + motor->sensor_direction * k * elec_step / motor->pole_pairs;
+            float error = raw - expected;
+            error -= _2PI * roundf(error / _2PI); // wrap to [-PI, PI]
+
+            uint16_t i = (uint16_t)roundf(raw * (ENCODER_LUT_SIZE / _2PI)) & (ENCODER_LUT_SIZE - 1);
+            sum[i] += error;
+            count[i]++;
+        }
+    }
+    motor->setPhaseVoltage(0, 0, 0);
+
+    // average the bins, the constant part of the error is just the starting point and is removed
+    float mean = 0.0f;
+    uint16_t filled = 0;
+    for (int i = 0; i < ENCODER_LUT_SIZE; i++) {
+        if (count[i] > 0) {
+            sum[i] /= count[i];
+            mean += sum[i];
+            filled++;
+        }
+    }
+
+    bool ok = filled == ENCODER_LUT_SIZE;
+    if (ok) {
+        mean /= filled;
+        for (int i = 0; i < ENCODER_LUT_SIZE; i++)
+            calibration.offset[i] = (int16_t)roundf((sum[i] - mean) / ENCODER_LUT_UNIT);
+        calibration.valid = true;
+    }
+
+    delete[] sum;
+    delete[] count;
+    return ok;
+};
+
+
+void NanoEncoder::setCalibration(EncoderCalibration& cal) {
+    calibration = cal;
+};
+
+
+EncoderCalibration& NanoEncoder::getCalibration() {
+    return calibration;
+};
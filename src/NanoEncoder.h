@@ -0,0 +1,57 @@
+#pragma once
+
+#include <SimpleFOC.h>
+#include <SimpleFOCDrivers.h>
+#include "encoders/mt6701/MagneticSensorMT6701SSI.h"
+#include "DeviceSettings.h"
+#include "nanofoc_d.h"
+#if NANO_ENCODER_DMA
+#include <driver/spi_master.h>
+#endif
+
+
+/**
+ * MT6701 SSI sensor with a linearization map.
+ * 
+ * Magnet misalignment makes the raw angle deviate from the true rotor angle by a smooth,
+ * mostly once or twice per turn error. calibrate() measures that error against the commanded
+ * electrical angle, and getSensorAngle() subtracts it again by interpolating the table.
+ *
+ * The FOC thread samples the sensor once at the start of every loop iteration with sample(),
+ * the update() from loopFOC() then reuses that reading instead of going to the bus again.
+ *
+ * With NANO_ENCODER_DMA the sensor is read through the ESP-IDF SPI master instead: every read picks up
+ * the transfer started by the previous one and starts the next, so the bus works while the loop computes.
+ * The angle is then one transfer old, age tells by how much.
+ */
+class NanoEncoder : public MagneticSensorMT6701SSI {
+public:
+    NanoEncoder(int nCS);
+
+    float getSensorAngle() override;
+    void update() override;
+    void sample();
+#if NANO_ENCODER_DMA
+    bool initDMA(int clk, int miso, int cs);
+#endif
+
+    bool calibrate(BLDCMotor* motor);
+    void setCalibration(EncoderCalibration& cal);
+    EncoderCalibration& getCalibration();
+
+    uint32_t reads = 0; // bus reads, for the loop statistics
+    uint32_t age = 0; // us from the sensor latching the sampled angle until sample() returned it
+
+protected:
+    EncoderCalibration calibration = { .valid = false };
+    bool sampled = false;
+    unsigned long sample_ts = 0;
+
+#if NANO_ENCODER_DMA
+    float readPipelined();
+
+    spi_device_handle_t dma_device = nullptr;
+    spi_transaction_t dma_trans;
+    unsigned long dma_start = 0;
+#endif
+};
@@ -1,7 +1,6 @@
 
 #include "audio.h"
 #include "nanofoc_d.h"
-#include "../haptic.h"
 
 #ifdef USE_AUDIO_LIB
 #include "XT_I2S_Audio.h"
@@ -278,8 +277,9 @@ void BinarisAudioPlayer::audio_loop(){
 };
 
 
-extern "C" void HapticInterface::UserHapticEventCallback(HapticEvt event, float currentAngle, uint16_t currentPos){
-  switch (event) {
+// Detent event listener, called from the HMI thread.
+void play_detent_audio(const DetentEvt& evt){
+  switch (evt.type) {
     case HapticEvt::INCREASE:
         audioPlayer.play_haptic_audio();
         break;
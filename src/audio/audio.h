@@ -4,6 +4,7 @@
 #include <inttypes.h>
 #include <driver/i2s.h>
 #include "./audio_api.h"
+#include "../haptic_api.h"
 #include <Arduino.h>
 
 typedef enum {
@@ -50,3 +51,5 @@ protected:
 
 
 extern BinarisAudioPlayer audioPlayer;
+
+void play_detent_audio(const DetentEvt& evt);
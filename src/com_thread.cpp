@@ -48,7 +48,10 @@ void ComThread::run() {
     dispatchLcdConfig();
     while (true) {
         JsonDocument doc;
-        if (Serial.available()) {
+        if (streaming) {
+            handleStreamFrames();
+        }
+        else if (Serial.available()) {
             String input = Serial.readStringUntil('\n');
             DeserializationError error = deserializeJson(doc, input);
             if (error) {
@@ -95,6 +98,18 @@ void ComThread::run() {
                 foc_thread.put_motor_command(new String("129=1"));
               }
             }
+            v = doc["anticogging"];
+            if (v.is<bool>()) { // calibrate or clear the anticogging table
+              foc_thread.put_motor_command(new String(v.as<bool>() ? "130=1" : "130=0"));
+            }
+            v = doc["linearize"];
+            if (v.is<bool>()) { // measure or clear the sensor linearization map
+              foc_thread.put_motor_command(new String(v.as<bool>() ? "131=1" : "131=0"));
+            }
+            v = doc["autotune"];
+            if (v.is<bool>()) { // step-response tune or reset the PID
+              foc_thread.put_motor_command(new String(v.as<bool>() ? "132=1" : "132=0"));
+            }
             v = doc["profiles"];
             if (v!=nullptr) { // list profiles
               handleProfilesCommand(v);
@@ -103,6 +118,30 @@ void ComThread::run() {
             if (v!=nullptr) { // get or set settings
               handleSettingsCommand(v);
             }
+            v = doc["stats"];
+            if (v!=nullptr) { // get FOC loop statistics
+              handleStatsCommand(v);
+            }
+            v = doc["scope"];
+            if (v!=nullptr) { // arm, query or dump the haptic scope
+              handleScopeCommand(v);
+            }
+            v = doc["effect"];
+            if (v.is<uint8_t>()) { // play a haptic effect at full strength
+              foc_thread.play_effect((HapticEffect)v.as<uint8_t>(), 255);
+            }
+            else if (v.is<JsonObject>() && v["id"].is<uint8_t>()) { // or with the given strength
+              uint8_t strength = v["strength"].is<uint8_t>() ? v["strength"].as<uint8_t>() : 255;
+              foc_thread.play_effect((HapticEffect)v["id"].as<uint8_t>(), strength);
+            }
+            v = doc["stream"];
+            if (v!=nullptr) { // enter binary setpoint streaming, or query it
+              handleStreamCommand(v);
+            }
+            v = doc["clip"];
+            if (v!=nullptr) { // play, record, write or stop a torque clip, or query it
+              handleClipCommand(v);
+            }
             if (doc["save"]) { // save settings and profiles to SPIFFS
               if (doc["save"].as<bool>()==true) {
                 DeviceSettings::getInstance().toSPIFFS();
@@ -137,6 +176,9 @@ void ComThread::run() {
             }
         }
 
+        // keep the torque clip moving to and from SPIFFS
+        foc_thread.service_clip();
+
         // send any outgoing messages
         handleMessages();
 
@@ -156,7 +198,7 @@ void ComThread::run() {
         else
           global_sleep_flag = true;
 
-        vTaskDelay(10); // give other threads a chance to run...
+        vTaskDelay(streaming ? 1 : 10); // give other threads a chance to run, but keep up with the stream
     }
 
 };
@@ -189,6 +231,12 @@ void ComThread::handleEvents() {
       if (hadEvent) {
         eventDoc.clear();
         eventDoc["p"] = angleEvt.cur_pos;
+        eventDoc["d"] = angleEvt.delta;
+        eventDoc["a"] = angleEvt.angle;
+        eventDoc["t"] = angleEvt.turns;
+        eventDoc["v"] = angleEvt.velocity;
+        eventDoc["q"] = angleEvt.torque;
+        eventDoc["ts"] = angleEvt.timestamp;
         serializeJson(eventDoc, Serial);
         Serial.println(); // add a newline
         ts_last_activity = millis();
@@ -219,6 +267,260 @@ void ComThread::handleSettingsCommand(JsonVariant s) {
 
 
 
+void ComThread::handleStatsCommand(JsonVariant s) {
+  if (s.isNull()) return;
+  LoopStats stats;
+  if (!foc_thread.get_loop_stats(&stats)) {
+    sendError("No loop statistics available yet");
+    return;
+  }
+  JsonDocument doc;
+  JsonObject obj = doc["stats"].to<JsonObject>();
+  obj["loopFreq"] = stats.loop_freq;
+  obj["loops"] = stats.loops;
+  obj["overruns"] = stats.overruns;
+  obj["sensorReads"] = stats.sensor_reads;
+  obj["sensorAge"] = stats.sensor_age;
+  obj["periodMin"] = stats.period_min;
+  obj["periodAvg"] = stats.period_avg;
+  obj["periodMax"] = stats.period_max;
+  JsonArray jitter = obj["jitter"].to<JsonArray>();
+  for (int i=0; i<LOOP_JITTER_BUCKETS; i++) {
+    jitter.add(stats.jitter[i]);
+  }
+  obj["hapticCyclesAvg"] = stats.haptic_cycles_avg;
+  obj["hapticCyclesMax"] = stats.haptic_cycles_max;
+  obj["predictLead"] = stats.predict_lead;
+  obj["predictErrorAvg"] = stats.prediction_error_avg;
+  obj["predictErrorMax"] = stats.prediction_error_max;
+  obj["predictBaselineAvg"] = stats.prediction_baseline_avg;
+  obj["streamFrames"] = stats.stream_frames;
+  obj["streamLatencyAvg"] = stats.stream_latency_avg;
+  obj["streamLatencyMax"] = stats.stream_latency_max;
+  obj["streamTimeouts"] = stats.stream_timeouts;
+  serializeJson(doc, Serial);
+  Serial.println(); // add a newline
+};
+
+
+
+void ComThread::handleClipCommand(JsonVariant c) {
+  if (c.is<JsonObject>()) {
+    if (c["play"].is<String>()) {
+      String name = c["play"].as<String>();
+      uint8_t strength = c["strength"].is<uint8_t>() ? c["strength"].as<uint8_t>() : 255;
+      if (!foc_thread.play_clip(name, strength))
+        sendError("Clip not found", name);
+    }
+    else if (c["record"].is<String>()) {
+      String name = c["record"].as<String>();
+      uint16_t rate = c["rate"].is<uint16_t>() ? c["rate"].as<uint16_t>() : CLIP_DEFAULT_RATE;
+      if (!foc_thread.record_clip(name, rate))
+        sendError("Clip not recorded", name);
+    }
+    else if (c["write"].is<String>() && c["samples"].is<JsonArray>()) {
+      String name = c["write"].as<String>();
+      uint16_t rate = c["rate"].is<uint16_t>() ? c["rate"].as<uint16_t>() : CLIP_DEFAULT_RATE;
+      bool append = c["append"].is<bool>() ? c["append"].as<bool>() : false;
+      if (!foc_thread.write_clip(name, rate, c["samples"].as<JsonArray>(), append))
+        sendError("Clip not written", name);
+    }
+    else if (c["stop"].is<bool>() && c["stop"].as<bool>()) {
+      foc_thread.stop_clip();
+    }
+  }
+  sendClipStatus();
+};
+
+
+void ComThread::sendClipStatus() {
+  JsonDocument doc;
+  JsonObject obj = doc["clip"].to<JsonObject>();
+  ClipState state = foc_thread.get_clip_state();
+  obj["state"] = state==CLIP_PLAYING ? "playing" : (state==CLIP_RECORDING ? "recording" : "idle");
+  obj["name"] = foc_thread.get_clip_name();
+  serializeJson(doc, Serial);
+  Serial.println(); // add a newline
+};
+
+
+
+void ComThread::handleStreamCommand(JsonVariant s) {
+  if (s.isNull()) return;
+  if (s.is<JsonObject>() || (s.is<bool>() && s.as<bool>())) { // start
+    uint32_t timeout = s["timeout"].is<uint32_t>() ? s["timeout"].as<uint32_t>() : STREAM_TIMEOUT_US;
+    streaming = true;
+    stream_len = 0;
+    stream_frames = 0;
+    stream_bad_frames = 0;
+    stream_lost_frames = 0;
+    stream_last_rx = millis();
+    stream_last_status = stream_last_rx;
+    foc_thread.start_stream(timeout);
+  }
+  else if (s.is<bool>()) { // stop
+    foc_thread.stop_stream();
+  }
+  sendStreamStatus();
+};
+
+
+
+/**
+ * Reads the binary setpoint frames while streaming. Everything available is consumed each pass,
+ * the FOC loop only ever sees the newest setpoint. Frames with a bad checksum are dropped and the
+ * reader resynchronises on the next sync byte. A stop frame or a silent host ends the stream.
+ */
+void ComThread::handleStreamFrames() {
+  while (Serial.available()) {
+    uint8_t b = Serial.read();
+    if (stream_len==0 && b!=STREAM_FRAME_SYNC)
+      continue;
+    stream_buf[stream_len++] = b;
+    if (stream_len<sizeof(StreamFrame))
+      continue;
+
+    uint8_t checksum = 0;
+    for (int i=0; i<sizeof(StreamFrame)-1; i++)
+      checksum ^= stream_buf[i];
+    StreamFrame frame;
+    memcpy(&frame, stream_buf, sizeof(frame));
+    if (checksum!=frame.checksum || frame.type>STREAM_FRAME_SETPOINT) {
+      stream_bad_frames++;
+      // resync on the next sync byte already buffered, the real frame may have started there
+      uint8_t* sync = (uint8_t*)memchr(stream_buf + 1, STREAM_FRAME_SYNC, stream_len - 1);
+      stream_len = sync!=nullptr ? stream_buf + stream_len - sync : 0;
+      if (stream_len>0)
+        memmove(stream_buf, sync, stream_len);
+      continue;
+    }
+    stream_len = 0;
+
+    stream_last_rx = millis();
+    ts_last_activity = stream_last_rx;
+    if (frame.type==STREAM_FRAME_STOP) {
+      stopStream();
+      return;
+    }
+    if (stream_frames>0)
+      stream_lost_frames += (uint16_t)(frame.seq - stream_last_seq - 1);
+    stream_last_seq = frame.seq;
+    stream_frames++;
+
+    StreamSetpoint setpoint = {
+      .torque = frame.torque,
+      .center = frame.center,
+      .stiffness = frame.stiffness,
+      .damping = frame.damping,
+      .seq = frame.seq,
+      .received = (uint32_t)micros()
+    };
+    foc_thread.put_stream_setpoint(setpoint);
+  }
+
+  unsigned long now = millis();
+  if (now - stream_last_rx > STREAM_IDLE_EXIT_MS) {
+    stopStream();
+  }
+  else if (now - stream_last_status >= STREAM_STATUS_MS) {
+    stream_last_status = now;
+    sendStreamStatus();
+  }
+};
+
+
+
+void ComThread::stopStream() {
+  foc_thread.stop_stream();
+  streaming = false;
+  stream_len = 0;
+  sendStreamStatus();
+};
+
+
+
+void ComThread::sendStreamStatus() {
+  JsonDocument doc;
+  JsonObject obj = doc["stream"].to<JsonObject>();
+  obj["active"] = streaming;
+  obj["driving"] = foc_thread.is_streaming();
+  obj["frames"] = stream_frames;
+  obj["badFrames"] = stream_bad_frames;
+  obj["lostFrames"] = stream_lost_frames;
+  obj["lastSeq"] = stream_last_seq;
+  LoopStats stats;
+  if (foc_thread.get_loop_stats(&stats)) {
+    obj["applied"] = stats.stream_frames;
+    obj["latencyAvg"] = stats.stream_latency_avg;
+    obj["latencyMax"] = stats.stream_latency_max;
+    obj["timeouts"] = stats.stream_timeouts;
+  }
+  serializeJson(doc, Serial);
+  Serial.println(); // add a newline
+};
+
+
+
+#define SCOPE_DUMP_CHUNK 32
+
+void ComThread::handleScopeCommand(JsonVariant s) {
+  if (s.isNull()) return;
+  static const char* state_names[] = { "idle", "armed", "capturing", "done" };
+  if (s.is<JsonObject>()) { // arm
+    String trigger = s["trigger"].is<String>() ? s["trigger"].as<String>() : "none";
+    ScopeTrigger t = ScopeTrigger::SCOPE_TRIGGER_NONE;
+    if (trigger=="detent")
+      t = ScopeTrigger::SCOPE_TRIGGER_DETENT;
+    else if (trigger=="limit")
+      t = ScopeTrigger::SCOPE_TRIGGER_LIMIT;
+    else if (trigger!="none") {
+      sendError("Unknown scope trigger", trigger);
+      return;
+    }
+    uint16_t decimation = s["decimation"].is<int>() ? s["decimation"].as<uint16_t>() : 1;
+    if (!foc_thread.arm_scope(t, decimation)) {
+      sendError("Scope capture already in progress");
+      return;
+    }
+  }
+  else if (s.as<String>()=="off") {
+    foc_thread.disarm_scope();
+  }
+  else if (s.as<String>()=="dump") {
+    const ScopeSample* samples = foc_thread.get_scope_samples();
+    if (samples==nullptr) {
+      sendError("No scope capture available yet");
+      return;
+    }
+    // one line per chunk, so the reply never needs the whole buffer as JSON in memory
+    for (int offset=0; offset<SCOPE_BUFFER_SIZE; offset+=SCOPE_DUMP_CHUNK) {
+      JsonDocument doc;
+      JsonObject obj = doc["scope"].to<JsonObject>();
+      obj["offset"] = offset;
+      obj["total"] = SCOPE_BUFFER_SIZE;
+      JsonArray arr = obj["samples"].to<JsonArray>();
+      for (int i=offset; i<offset+SCOPE_DUMP_CHUNK && i<SCOPE_BUFFER_SIZE; i++) {
+        JsonArray sample = arr.add<JsonArray>();
+        sample.add(samples[i].timestamp);
+        sample.add(samples[i].angle);
+        sample.add(samples[i].velocity);
+        sample.add(samples[i].attract_angle);
+        sample.add(samples[i].error);
+        sample.add(samples[i].output);
+      }
+      serializeJson(doc, Serial);
+      Serial.println(); // add a newline
+    }
+    return;
+  }
+  JsonDocument doc;
+  doc["scope"]["state"] = state_names[foc_thread.get_scope_state()];
+  serializeJson(doc, Serial);
+  Serial.println(); // add a newline
+};
+
+
+
 void ComThread::handleMessages() {
   StringMessage incoming;
   JsonDocument doc;
@@ -253,6 +555,15 @@ void ComThread::handleMessages() {
           sendDoc = true;
         }
         break;
+      case STRING_MESSAGE_CLIP:
+        if (incoming.message!=nullptr) {
+          if (!foc_thread.play_clip(*incoming.message, incoming.value)) {
+            doc["error"] = "Clip not found";
+            doc["msg"] = *incoming.message;
+            sendDoc = true;
+          }
+        }
+        break;
       case STRING_MESSAGE_NEXT_PROFILE:
         pName = pm.getNextProfileName();
         if (pName!="") {
@@ -465,6 +776,7 @@ void ComThread::dispatchSettings() {
     };
     hmi_thread.put_settings(hmiSettings);
     global_idle_timeout = ds.idleTimeout;
+    foc_thread.set_angle_event_decimation(ds.eventMinAngle, ds.eventMinInterval);
 };
 
 
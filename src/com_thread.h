@@ -14,18 +14,46 @@ enum StringMessageType {
     STRING_MESSAGE_MOTOR,
     STRING_MESSAGE_PROFILE,
     STRING_MESSAGE_NEXT_PROFILE,
-    STRING_MESSAGE_PREV_PROFILE
+    STRING_MESSAGE_PREV_PROFILE,
+    STRING_MESSAGE_CLIP
 };
 
 class StringMessage {
     public:
-        StringMessage(String* message = nullptr, StringMessageType type = StringMessageType::STRING_MESSAGE_DEBUG) : message(message),  type(type) {};
+        StringMessage(String* message = nullptr, StringMessageType type = StringMessageType::STRING_MESSAGE_DEBUG, uint8_t value = 0) : message(message),  type(type), value(value) {};
         String* message;// = nullptr;
         StringMessageType type;
+        uint8_t value; // e.g. the strength of a clip
 };
 
 
 
+#define STREAM_FRAME_SYNC 0xA5
+#define STREAM_IDLE_EXIT_MS 1000 // streaming mode ends, back to JSON, when the host sent nothing for this long
+#define STREAM_STATUS_MS 1000 // stream status report interval while streaming
+
+typedef enum : uint8_t {
+    STREAM_FRAME_STOP = 0,
+    STREAM_FRAME_SETPOINT = 1
+} StreamFrameType;
+
+/**
+ * Binary setpoint frame sent back to back by the host in streaming mode, little endian.
+ * The fields map onto StreamSetpoint, checksum is the xor of all preceding bytes.
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t sync;
+    uint8_t type;
+    uint16_t seq;
+    float torque;
+    float center;
+    float stiffness;
+    float damping;
+    uint8_t checksum;
+} StreamFrame;
+
+
+
 class ComThread : public Thread<ComThread> {
     friend class Thread<ComThread>; //Allow Base Thread to invoke protected run()
     public:
@@ -45,6 +73,14 @@ class ComThread : public Thread<ComThread> {
         void handleProfileCommand(JsonVariant profile, JsonVariant updates);
         void handleSettingsCommand(JsonVariant s);
         void handleProfilesCommand(JsonVariant p);
+        void handleStatsCommand(JsonVariant s);
+        void handleScopeCommand(JsonVariant s);
+        void handleStreamCommand(JsonVariant s);
+        void handleClipCommand(JsonVariant c);
+        void sendClipStatus();
+        void handleStreamFrames();
+        void stopStream();
+        void sendStreamStatus();
         void handleMessages();
         void handleEvents();
 
@@ -63,6 +99,17 @@ class ComThread : public Thread<ComThread> {
         void sendError(const char* error, const char* msg = nullptr);
 
         QueueHandle_t _q_strings_in;
+
+        // streaming mode, the serial input is binary StreamFrames instead of JSON lines
+        bool streaming = false;
+        uint8_t stream_buf[sizeof(StreamFrame)];
+        uint8_t stream_len = 0;
+        uint16_t stream_last_seq = 0;
+        uint32_t stream_frames = 0;
+        uint32_t stream_bad_frames = 0;
+        uint32_t stream_lost_frames = 0;
+        unsigned long stream_last_rx = 0;
+        unsigned long stream_last_status = 0;
 };
 
 
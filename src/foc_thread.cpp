@@ -1,6 +1,7 @@
 #include "./foc_thread.h"
 #include "utils.h"
 #include "HapticCommander.h"
+#include "NanoEncoder.h"
 #include "./com_thread.h"
 
 
@@ -14,34 +15,54 @@
 BLDCMotor motor = BLDCMotor(7, 5.3);
 BLDCDriver3PWM driver = BLDCDriver3PWM(PIN_IN_U, PIN_IN_V, PIN_IN_W, PIN_EN_U, PIN_EN_V, PIN_EN_W);
 
-MagneticSensorMT6701SSI encoder(PIN_MAG_CS);
+NanoEncoder encoder(PIN_MAG_CS);
 
 HapticInterface haptic = HapticInterface(&motor);
-HapticCommander commander = HapticCommander(&motor);
+HapticCommander commander = HapticCommander(&motor, &haptic, &encoder);
 
+#if NANO_LOOP_FREQ > 0
+// Loop timer ticks at 10MHz (80MHz APB / 8), and wakes the FOC thread every NANO_LOOP_FREQ period.
+#define FOC_TIMER_NUM 0
+#define FOC_TIMER_DIVIDER 8
+#define FOC_TIMER_TICKS_PER_SECOND (80000000 / FOC_TIMER_DIVIDER)
+
+hw_timer_t* foc_timer = nullptr;
+
+void IRAM_ATTR foc_timer_isr() {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(foc_thread.getHandle(), &woken);
+    if (woken == pdTRUE)
+        portYIELD_FROM_ISR();
+}
+#endif
 
 
 FocThread::FocThread(const uint8_t task_core) : Thread("FOC", 8192, 1, task_core) {
     _q_motor_in = xQueueCreate(5, sizeof( String* ));
-    _q_haptic_in = xQueueCreate(2, sizeof( DetentProfile ));
-    _q_angleevt_out = xQueueCreate(5, sizeof( AngleEvt ));
+    _q_angleevt_out = xQueueCreate(1, sizeof( AngleEvt )); // last value wins, see handleHousekeeping()
     assert(_q_motor_in != NULL);
-    assert(_q_haptic_in != NULL);
+    _q_loopstats_out = xQueueCreate(1, sizeof( LoopStats ));
     assert(_q_angleevt_out != NULL);
+    assert(_q_loopstats_out != NULL);
 }
 
 FocThread::~FocThread() {}
 
 
 void FocThread::init(DetentProfile& initialConfig) {
-    haptic.haptic_state = HapticState(initialConfig);
+    put_haptic_config(initialConfig);
 };
 
 
 void FocThread::run() {
+    #if NANO_ENCODER_DMA
+    if (!encoder.initDMA(PIN_MAG_CLK, PIN_MAG_DO, PIN_MAG_CS))
+        com_thread.put_string_message(StringMessage(new String("Sensor SPI init failed!"), StringMessageType::STRING_MESSAGE_ERROR));
+    #else
     SPIClass* spi = new SPIClass(HSPI);
     spi->begin(PIN_MAG_CLK, PIN_MAG_DO, -1, PIN_MAG_CS);
     encoder.init(spi);
+    #endif
 
     driver.voltage_power_supply = 5.0f; // TODO global settings
     driver.voltage_limit = 5.0f;
@@ -65,40 +86,338 @@ void FocThread::run() {
     if (initResult == 0) {
         com_thread.put_string_message(StringMessage(new String("Motor init failed!"), StringMessageType::STRING_MESSAGE_ERROR));
     }
+    haptic_states.update();
+    haptic.haptic_state = &haptic_states.front();
     haptic.init();
     haptic.motor->sensor_offset = haptic.motor->shaft_angle;
-    // float lastang = encoder.getAngle();
-    // unsigned long ts = micros();
-    uint16_t serial_last_pos = 0;
+
+    cycles_to_us = 1.0f / ESP.getCpuFreqMHz();
+    resetLoopStats();
+    stats_last_cycles = ESP.getCycleCount();
+
+    #if NANO_LOOP_FREQ > 0
+    // Fast path runs on every timer tick, housekeeping only at NANO_HOUSEKEEPING_FREQ
+    const uint32_t housekeeping_divider = max(NANO_LOOP_FREQ / NANO_HOUSEKEEPING_FREQ, 1);
+    stats_nominal_cycles = ESP.getCpuFreqMHz() * 1000000 / NANO_LOOP_FREQ;
+    foc_timer = timerBegin(FOC_TIMER_NUM, FOC_TIMER_DIVIDER, true);
+    timerAttachInterrupt(foc_timer, &foc_timer_isr, true);
+    timerAlarmWrite(foc_timer, FOC_TIMER_TICKS_PER_SECOND / NANO_LOOP_FREQ, true);
+    timerAlarmEnable(foc_timer);
+    #else
+    const uint32_t housekeeping_divider = 1;
+    #endif
+
+    uint32_t ticks = 0;
     while (true) {
-        haptic.haptic_loop();
-        float ang = encoder.getAngle();
-        unsigned long now = micros();
-        // if (fabs(ang - lastang) >= angleEventMinAngle && now - ts >= angleEventMinMicroseconds) {
-        if (haptic.haptic_state.current_pos != serial_last_pos){
-            AngleEvt ae = { haptic.haptic_state.current_pos };
-            xQueueSend(_q_angleevt_out, &ae, (TickType_t)0);
-            serial_last_pos = haptic.haptic_state.current_pos;
-        }
-        
-        
-        handleMessage();
+        uint32_t overruns = 0;
+        #if NANO_LOOP_FREQ > 0
+        // more than one pending notification means we missed timer ticks
+        uint32_t pending = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        overruns = pending - 1;
+        #endif
+        updateLoopStats(overruns);
+
+        // one sensor reading per iteration, shared by the haptics, loopFOC(), events and telemetry
+        encoder.sample();
+        uint32_t sampled_cycles = ESP.getCycleCount();
+        motor.shaft_angle = motor.shaftAngle();
+        stats_sensor_age += encoder.age;
+        #if NANO_ANGLE_PREDICTION
+        haptic.predict_lead = (encoder.age + predict_compute_us + NANO_PWM_APPLY_DELAY_US) * 1e-6f;
+        #endif
+
         handleHapticConfig();
+        handleEffects();
+        handleClip();
+        if (!handleStream()) {
+            uint32_t haptic_start = ESP.getCycleCount();
+            haptic.haptic_loop();
+            uint32_t haptic_end = ESP.getCycleCount();
+            uint32_t haptic_cycles = haptic_end - haptic_start;
+            stats_haptic_cycles += haptic_cycles;
+            stats_haptic_cycles_max = max(stats_haptic_cycles_max, haptic_cycles);
+            stats_haptic_loops++;
+            predict_compute_us = (haptic_end - sampled_cycles) * cycles_to_us;
+            stats_predict_lead += haptic.predict_lead;
+            if (haptic.prediction_checks != prediction_checks_seen) {
+                prediction_checks_seen = haptic.prediction_checks;
+                stats_prediction_checks++;
+                stats_prediction_error += fabsf(haptic.prediction_error);
+                stats_prediction_error_max = max(stats_prediction_error_max, fabsf(haptic.prediction_error));
+                stats_prediction_baseline += fabsf(haptic.prediction_baseline);
+            }
+        }
+        handleClipRecording();
+        publishSnapshot();
+        captureScope();
+
+        if (++ticks >= housekeeping_divider) {
+            ticks = 0;
+            handleHousekeeping();
+        }
     }
         
 };
 
+
+void FocThread::handleHousekeeping() {
+    // position changes are always reported, plain movement is decimated by angle and time
+    float ang = motor.shaft_angle;
+    unsigned long now = micros();
+    bool moved = fabsf(ang - event_last_angle) >= angleEventMinAngle.load(std::memory_order_relaxed)
+        && now - event_last_ts >= angleEventMinMicroseconds.load(std::memory_order_relaxed);
+    if (haptic.haptic_state->current_pos != serial_last_pos || moved) {
+        int32_t turns = floorf(ang / _2PI);
+        AngleEvt ae = {
+            .cur_pos = haptic.haptic_state->current_pos,
+            .delta = (int32_t)((uint32_t)haptic.haptic_state->current_pos - (uint32_t)serial_last_pos),
+            .angle = ang - turns * _2PI,
+            .turns = turns,
+            .velocity = motor.shaft_velocity,
+            .torque = haptic.haptic_output,
+            .timestamp = (uint32_t)now
+        };
+        // replaces an event the comms thread hasn't picked up yet instead of dropping the new one,
+        // carrying its delta over so relative readers don't lose detents
+        AngleEvt pending;
+        if (xQueueReceive(_q_angleevt_out, &pending, (TickType_t)0))
+            ae.delta += pending.delta;
+        xQueueOverwrite(_q_angleevt_out, &ae);
+        serial_last_pos = haptic.haptic_state->current_pos;
+        event_last_angle = ang;
+        event_last_ts = now;
+    }
+
+    handleMessage();
+
+    if (micros() - stats_window_start >= 1000000)
+        publishLoopStats();
+};
+
+
+void FocThread::resetLoopStats() {
+    stats_min_cycles = UINT32_MAX;
+    stats_max_cycles = 0;
+    stats_sum_cycles = 0;
+    stats_loops = 0;
+    stats_overruns = 0;
+    memset(stats_jitter, 0, sizeof(stats_jitter));
+    stats_sensor_reads = encoder.reads;
+    stats_sensor_age = 0;
+    stats_haptic_cycles = 0;
+    stats_haptic_cycles_max = 0;
+    stats_haptic_loops = 0;
+    stats_predict_lead = 0.0f;
+    stats_prediction_checks = 0;
+    stats_prediction_error = 0.0f;
+    stats_prediction_error_max = 0.0f;
+    stats_prediction_baseline = 0.0f;
+    stats_stream_frames = 0;
+    stats_stream_latency_sum = 0;
+    stats_stream_latency_max = 0;
+    stats_window_start = micros();
+};
+
+
+/**
+ * Called at the start of every loop iteration, measures the period since the previous one
+ * with the CPU cycle counter.
+ */
+void FocThread::updateLoopStats(uint32_t overruns) {
+    uint32_t now = ESP.getCycleCount();
+    uint32_t period = now - stats_last_cycles;
+    stats_last_cycles = now;
+
+    stats_min_cycles = min(stats_min_cycles, period);
+    stats_max_cycles = max(stats_max_cycles, period);
+    stats_sum_cycles += period;
+    stats_loops++;
+    stats_overruns += overruns;
+
+    uint32_t deviation = period > stats_nominal_cycles ? period - stats_nominal_cycles : stats_nominal_cycles - period;
+    uint32_t deviation_us = deviation * cycles_to_us;
+    uint8_t bucket = deviation_us == 0 ? 0 : 32 - __builtin_clz(deviation_us);
+    stats_jitter[min(bucket, (uint8_t)(LOOP_JITTER_BUCKETS - 1))]++;
+};
+
+
+void FocThread::publishLoopStats() {
+    LoopStats stats;
+    stats.loop_freq = NANO_LOOP_FREQ;
+    stats.loops = stats_loops;
+    stats.overruns = stats_overruns;
+    stats.sensor_reads = encoder.reads - stats_sensor_reads;
+    stats.sensor_age = stats_loops > 0 ? (float)stats_sensor_age / stats_loops : 0.0f;
+    stats.period_min = stats_min_cycles * cycles_to_us;
+    stats.period_avg = stats_loops > 0 ? (stats_sum_cycles / stats_loops) * cycles_to_us : 0.0f;
+    stats.period_max = stats_max_cycles * cycles_to_us;
+    memcpy(stats.jitter, stats_jitter, sizeof(stats_jitter));
+    stats.haptic_cycles_avg = stats_haptic_loops > 0 ? stats_haptic_cycles / stats_haptic_loops : 0;
+    stats.haptic_cycles_max = stats_haptic_cycles_max;
+    stats.predict_lead = stats_haptic_loops > 0 ? stats_predict_lead / stats_haptic_loops * 1e6f : 0.0f;
+    stats.prediction_error_avg = stats_prediction_checks > 0 ? stats_prediction_error / stats_prediction_checks : 0.0f;
+    stats.prediction_error_max = stats_prediction_error_max;
+    stats.prediction_baseline_avg = stats_prediction_checks > 0 ? stats_prediction_baseline / stats_prediction_checks : 0.0f;
+    stats.stream_frames = stats_stream_frames;
+    stats.stream_latency_avg = stats_stream_frames > 0 ? (float)stats_stream_latency_sum / stats_stream_frames : 0.0f;
+    stats.stream_latency_max = stats_stream_latency_max;
+    stats.stream_timeouts = stats_stream_timeouts;
+    xQueueOverwrite(_q_loopstats_out, &stats);
+
+    #if NANO_LOOP_FREQ == 0
+    // when free-running, measure jitter against the average of the last window
+    if (stats_loops > 0)
+        stats_nominal_cycles = stats_sum_cycles / stats_loops;
+    #endif
+    resetLoopStats();
+};
+
+
 void FocThread::put_motor_command(String* message) {
-    if (message!=nullptr)
+    if (message!=nullptr) {
         xQueueSend(_q_motor_in, &message, (TickType_t)0);
+        motor_command_pending.store(true, std::memory_order_release);
+    }
 };
 
 
+// call from a single thread only (setup, then the comms thread)
 void FocThread::put_haptic_config(DetentProfile& profile) {
-    xQueueSend(_q_haptic_in, &profile, (TickType_t)0);
+    // the new state is built here, off the FOC hot path, the FOC thread only swaps a pointer
+    haptic_states.back() = HapticState(profile);
+    haptic_states.publish();
+};
+
+
+
+
+/**
+ * Arms the scope, the FOC thread starts recording once the trigger fires and
+ * keeps every decimation-th loop iteration until the buffer is full.
+ * Call from the comms thread only, fails while a capture is armed or running.
+ */
+bool FocThread::arm_scope(ScopeTrigger trigger, uint16_t decimation) {
+    uint8_t state = scope_state.load(std::memory_order_acquire);
+    if (state == SCOPE_ARMED || state == SCOPE_CAPTURING)
+        return false;
+    scope_trigger.store(trigger, std::memory_order_relaxed);
+    scope_decimation.store(max(decimation, (uint16_t)1), std::memory_order_relaxed);
+    scope_state.store(SCOPE_ARMED, std::memory_order_release);
+    return true;
 };
 
 
+// call from the comms thread only, stops an armed capture before it triggers or discards a finished one
+bool FocThread::disarm_scope() {
+    uint8_t expected = SCOPE_ARMED;
+    if (scope_state.compare_exchange_strong(expected, SCOPE_IDLE, std::memory_order_acq_rel))
+        return true;
+    expected = SCOPE_DONE;
+    return scope_state.compare_exchange_strong(expected, SCOPE_IDLE, std::memory_order_acq_rel);
+};
+
+
+ScopeState FocThread::get_scope_state() {
+    return (ScopeState)scope_state.load(std::memory_order_acquire);
+};
+
+
+// the samples are only handed out once the capture is done, the FOC thread doesn't touch them until re-armed
+const ScopeSample* FocThread::get_scope_samples() {
+    if (scope_state.load(std::memory_order_acquire) != SCOPE_DONE)
+        return nullptr;
+    return scope_samples;
+};
+
+
+/**
+ * Called once per loop iteration after the haptic loop, stores one sample while capturing.
+ * Never blocks and never touches Serial, the buffer is dumped by the comms thread.
+ */
+void FocThread::captureScope() {
+    bool detent_changed = haptic.haptic_state->current_pos != scope_last_pos;
+    scope_last_pos = haptic.haptic_state->current_pos;
+
+    uint8_t state = scope_state.load(std::memory_order_acquire);
+    if (state == SCOPE_ARMED) {
+        bool triggered;
+        switch (scope_trigger.load(std::memory_order_relaxed)) {
+            case SCOPE_TRIGGER_DETENT:
+                triggered = detent_changed;
+                break;
+            case SCOPE_TRIGGER_LIMIT:
+                triggered = haptic.haptic_state->atLimit;
+                break;
+            default:
+                triggered = true;
+                break;
+        }
+        if (!triggered)
+            return;
+        // the comms thread may have disarmed in the meantime
+        uint8_t expected = SCOPE_ARMED;
+        if (!scope_state.compare_exchange_strong(expected, SCOPE_CAPTURING, std::memory_order_acq_rel))
+            return;
+        scope_count = 0;
+        scope_skip = 0;
+        scope_start = micros();
+    }
+    else if (state != SCOPE_CAPTURING)
+        return;
+
+    if (scope_skip > 0) {
+        scope_skip--;
+        return;
+    }
+    scope_skip = scope_decimation.load(std::memory_order_relaxed) - 1;
+
+    ScopeSample& sample = scope_samples[scope_count];
+    sample.timestamp = micros() - scope_start;
+    sample.angle = motor.shaft_angle;
+    sample.velocity = motor.shaft_velocity;
+    sample.attract_angle = haptic.haptic_state->attract_angle;
+    sample.error = haptic.haptic_error;
+    sample.output = haptic.haptic_output;
+
+    if (++scope_count >= SCOPE_BUFFER_SIZE)
+        scope_state.store(SCOPE_DONE, std::memory_order_release);
+};
+
+
+// min_angle 0 streams events at the min_microseconds rate, even when the knob doesn't move
+void FocThread::set_angle_event_decimation(float min_angle, uint32_t min_microseconds) {
+    angleEventMinAngle.store(min_angle, std::memory_order_relaxed);
+    angleEventMinMicroseconds.store(min_microseconds, std::memory_order_relaxed);
+};
+
+
+/**
+ * Called from the haptic loop for every haptic event. Only pushes into the detent event ring,
+ * the HMI thread fans the events out to audio and the other listeners.
+ * Repeated limit events (one per loop iteration while pushing against an endstop) are only pushed once.
+ */
+void FocThread::put_detent_event(HapticEvt type, int32_t pos) {
+    if (type == HapticEvt::EITHER)
+        return;
+    bool repeated_limit = (type == HapticEvt::LIMIT_POS || type == HapticEvt::LIMIT_NEG) && type == last_detent_event;
+    last_detent_event = type;
+    if (repeated_limit)
+        return;
+    DetentEvt evt = { type, pos, (uint32_t)micros() };
+    detent_events.push(evt); // when the ring is full the event is dropped, the loop never waits
+};
+
+
+// call from the HMI thread only
+bool FocThread::get_detent_event(DetentEvt* evt) {
+    return detent_events.pop(*evt);
+};
+
+
+// Runs in the haptic loop on the FOC core, must not block.
+void HapticInterface::UserHapticEventCallback(HapticEvt event, float currentAngle, int32_t currentPos){
+    foc_thread.put_detent_event(event, currentPos);
+};
 
 
 bool FocThread::get_angle_event(AngleEvt* evt) {
@@ -106,6 +425,34 @@ bool FocThread::get_angle_event(AngleEvt* evt) {
 };
 
 
+bool FocThread::get_loop_stats(LoopStats* stats) {
+    return xQueuePeek(_q_loopstats_out, stats, (TickType_t)0);
+};
+
+
+
+void FocThread::publishSnapshot() {
+    HapticSnapshot snap = {
+        .current_pos = haptic.haptic_state->current_pos,
+        .last_pos = haptic.haptic_state->last_pos,
+        .start_pos = haptic.haptic_state->detent_profile.start_pos,
+        .end_pos = haptic.haptic_state->detent_profile.end_pos,
+        .endless = haptic.haptic_state->detent_profile.endless,
+        .angle = motor.shaft_angle,
+        .velocity = motor.shaft_velocity,
+        .at_limit = haptic.haptic_state->atLimit,
+        .was_at_limit = haptic.haptic_state->wasAtLimit
+    };
+    snapshot.write(snap);
+};
+
+
+// call from any thread, prefer this over the pass_*() accessors when reading more than one field
+HapticSnapshot FocThread::get_snapshot() {
+    return snapshot.read();
+};
+
+
 
 uint16_t FocThread::pass_actual_pos(){
 
@@ -114,24 +461,24 @@ uint16_t FocThread::pass_actual_pos(){
     return pointer;
 }
 
-uint16_t FocThread::pass_cur_pos(){
-    return haptic.haptic_state.current_pos;
+int32_t FocThread::pass_cur_pos(){
+    return snapshot.read().current_pos;
 }
 
 uint16_t FocThread::pass_start_pos(){
-    return haptic.haptic_state.detent_profile.start_pos;
+    return snapshot.read().start_pos;
 }
 
 uint16_t FocThread::pass_end_pos(){
-    return haptic.haptic_state.detent_profile.end_pos;
+    return snapshot.read().end_pos;
 }
 
-uint16_t FocThread::pass_last_pos(){
-    return haptic.haptic_state.last_pos;
+int32_t FocThread::pass_last_pos(){
+    return snapshot.read().last_pos;
 }
 
 bool FocThread::pass_at_limit(){
-    return haptic.haptic_state.atLimit;
+    return snapshot.read().at_limit;
 }
 
 
@@ -139,14 +486,17 @@ bool FocThread::pass_at_limit(){
 
 
 float FocThread::get_motor_angle() {
-    return motor.shaft_angle;
+    return snapshot.read().angle;
 };
 
 void FocThread::handleMessage() {
+    // only touch the queue when something was put
+    if (!motor_command_pending.load(std::memory_order_relaxed))
+        return;
+    motor_command_pending.exchange(false, std::memory_order_acq_rel);
     String* message = nullptr;
-    if (xQueueReceive(_q_motor_in, &message, (TickType_t)0)) {
+    while (xQueueReceive(_q_motor_in, &message, (TickType_t)0)) {
         if (message!=nullptr) {
-            Serial.println("Received and handling message: "+*message);
             commander.handleMessage(message);
             StringMessage smsg(message, StringMessageType::STRING_MESSAGE_MOTOR);
             com_thread.put_string_message(smsg); // message String* is returned to comms thread, where it is deleted if necessary
@@ -155,16 +505,178 @@ void FocThread::handleMessage() {
 };
 
 
+// call from the comms thread only, the FOC loop follows the stream from the first setpoint on
+void FocThread::start_stream(uint32_t timeout_us) {
+    stream_timeout.store(max(timeout_us, (uint32_t)1000), std::memory_order_relaxed);
+    stream_enabled.store(true, std::memory_order_release);
+};
+
+
+void FocThread::stop_stream() {
+    stream_enabled.store(false, std::memory_order_release);
+};
+
+
+// call from the comms thread only, the slot always holds the newest setpoint, older ones are simply replaced
+void FocThread::put_stream_setpoint(const StreamSetpoint& setpoint) {
+    stream_slot.write(setpoint);
+};
+
+
+// true while the setpoints drive the knob, false when stopped or the watchdog fell back to the profile haptics
+bool FocThread::is_streaming() {
+    return stream_active.load(std::memory_order_acquire);
+};
+
+
+/**
+ * Called once per loop iteration in place of the haptic loop, returns false when the profile haptics
+ * should run instead. A new setpoint is only copied out of the slot when its version changed.
+ * If none arrives within the timeout the watchdog hands the knob back to the profile haptics,
+ * re-anchored at the current angle so the detents don't jump.
+ */
+bool FocThread::handleStream() {
+    bool active = stream_active.load(std::memory_order_relaxed);
+    if (!stream_enabled.load(std::memory_order_acquire)) {
+        if (active) {
+            stream_active.store(false, std::memory_order_release);
+            haptic.reanchor();
+        }
+        return false;
+    }
+
+    unsigned long now = micros();
+    // the version has to come from the same read as the setpoint, a write in between would count a frame twice
+    uint32_t version;
+    StreamSetpoint setpoint = stream_slot.read(version);
+    if (version != stream_version) {
+        stream_version = version;
+        stream_setpoint = setpoint;
+        stream_last_frame = now;
+        uint32_t latency = now - stream_setpoint.received;
+        stats_stream_frames++;
+        stats_stream_latency_sum += latency;
+        stats_stream_latency_max = max(stats_stream_latency_max, latency);
+        if (!active)
+            stream_active.store(active = true, std::memory_order_release);
+    }
+    else if (active && now - stream_last_frame > stream_timeout.load(std::memory_order_relaxed)) {
+        stats_stream_timeouts++;
+        stream_active.store(active = false, std::memory_order_release);
+        haptic.reanchor();
+    }
+
+    if (!active)
+        return false;
+
+    float torque = stream_setpoint.torque
+        + stream_setpoint.stiffness * (stream_setpoint.center - motor.shaft_angle)
+        - stream_setpoint.damping * motor.shaft_velocity;
+    haptic.direct_loop(torque);
+    return true;
+};
+
+
+
+/**
+ * Triggers a haptic effect, call from any thread. Never blocks, if two triggers arrive
+ * within the same loop iteration the later one wins.
+ */
+void FocThread::play_effect(HapticEffect effect, uint8_t strength) {
+    if (effect == HapticEffect::EFFECT_NONE || effect >= HAPTIC_EFFECT_COUNT)
+        return;
+    effect_request.store((uint16_t)(strength << 8 | effect), std::memory_order_release);
+};
+
+
+// once per loop: start a requested effect, the haptic module plays it from its table
+void FocThread::handleEffects() {
+    if (effect_request.load(std::memory_order_relaxed) == 0)
+        return;
+    uint16_t request = effect_request.exchange(0, std::memory_order_acquire);
+    if (request != 0)
+        haptic.start_effect((HapticEffect)(request & 0xFF), request >> 8);
+};
+
+
+
+// call from the comms thread only, the clip functions do file IO
+bool FocThread::play_clip(const String& name, uint8_t strength) {
+    return clip.play(name, strength);
+};
+
+
+bool FocThread::record_clip(const String& name, uint16_t rate) {
+    return clip.record(name, rate);
+};
+
+
+void FocThread::stop_clip() {
+    clip.stop();
+};
+
+
+// call regularly, keeps the playing clip loaded and writes out the recording
+void FocThread::service_clip() {
+    clip.service();
+};
+
+
+bool FocThread::write_clip(const String& name, uint16_t rate, JsonArray samples, bool append) {
+    return clip.write(name, rate, samples, append);
+};
+
+
+ClipState FocThread::get_clip_state() {
+    return clip.get_state();
+};
+
+
+const String& FocThread::get_clip_name() {
+    return clip.get_name();
+};
+
+
+// once per loop, before the haptics: the clip sample for now goes on top of them
+void FocThread::handleClip() {
+    haptic.clip_torque = clip.play_sample(micros()) * haptic.haptic_state->pid.limit;
+};
+
+
+// once per loop, after the haptics: this iteration's texture torque goes into a recording, without the
+// anticogging, effect or clip on top, so a recording played back doesn't add them a second time
+void FocThread::handleClipRecording() {
+    clip.record_sample(haptic.kernel_output / haptic.haptic_state->pid.limit, micros());
+};
+
+
+
 void FocThread::handleHapticConfig() {
-    DetentProfile profile;
-    if (xQueueReceive(_q_haptic_in, &profile, (TickType_t)0)) {
-        // apply haptic config to motor
-        haptic.haptic_state = HapticState(profile);
+    // once per loop: adopt the newest haptic state, if one was published, crossfading from the current one
+    if (haptic_states.pending()) {
+        haptic.capture_state();
+        haptic_states.update();
+        haptic.switch_state(&haptic_states.front());
     }
 };
 
 
 
+// call before the thread is started
+void FocThread::setCalibration(EncoderCalibration& cal){
+    encoder.setCalibration(cal);
+};
+
+// call before the thread is started, profiles loaded afterwards pick it up. Afterwards only the FOC thread writes it
+void FocThread::setCalibration(PidTuning& tuning){
+    pid_tuning.write(tuning);
+};
+
+// call before the thread is started
+void FocThread::setCalibration(AnticoggingTable& table){
+    haptic.anticogging = table;
+};
+
 void FocThread::setCalibration(MotorCalibration& cal){
     haptic.motor->zero_electric_angle = cal.zero_angle;
     haptic.motor->sensor_direction = cal.direction==0 ? Direction::UNKNOWN : ( cal.direction==1 ? Direction::CW : Direction::CCW);
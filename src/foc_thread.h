@@ -2,12 +2,111 @@
 
 #include <Arduino.h>
 #include "thread_crtp.h"
+#include "seqlock.h"
+#include "triple_buffer.h"
+#include "spsc_ring.h"
+#include "haptic_clip.h"
+#include <atomic>
 #include "haptic.h"
 #include "nanofoc_d.h"
 #include "DeviceSettings.h"
 #include "audio/audio_api.h"
 
 
+#define LOOP_JITTER_BUCKETS 8
+
+/**
+ * FOC loop timing, published once per second by the FOC thread.
+ * Periods are in microseconds. Jitter is the deviation of each loop period from the nominal period
+ * (or the previous average when free-running), binned by powers of two: <1us, <2us, <4us, ...
+ * with the last bucket collecting everything larger.
+ */
+typedef struct {
+    uint32_t loop_freq;
+    uint32_t loops;
+    uint32_t overruns;
+    uint32_t sensor_reads;
+    float sensor_age;
+    float period_min;
+    float period_avg;
+    float period_max;
+    uint32_t jitter[LOOP_JITTER_BUCKETS];
+    uint32_t haptic_cycles_avg; // CPU cycles spent in haptic_loop(), FOC step included
+    uint32_t haptic_cycles_max;
+    float predict_lead;         // us the angle is extrapolated by, sensor age plus the time until the output is applied
+    float prediction_error_avg; // rad, mean absolute error of the extrapolated angle against the one measured once the lead has passed
+    float prediction_error_max;
+    float prediction_baseline_avg; // rad, the same without extrapolating, for comparison
+    uint32_t stream_frames;     // setpoints applied
+    float stream_latency_avg;   // us from the comms thread receiving a setpoint until the loop applied it
+    float stream_latency_max;
+    uint32_t stream_timeouts;   // watchdog fallbacks to the profile haptics, since boot
+} LoopStats;
+
+
+/**
+ * Consistent view of the haptic state, published by the FOC thread once per loop
+ * for readers on the other core.
+ */
+typedef struct {
+    int32_t current_pos;
+    int32_t last_pos;
+    uint16_t start_pos;
+    uint16_t end_pos;
+    bool endless;
+    float angle;
+    float velocity;
+    bool at_limit;
+    bool was_at_limit;
+} HapticSnapshot;
+
+
+/**
+ * Host-streamed setpoint, written by the comms thread and applied by the FOC loop every iteration.
+ * The knob torque is torque + stiffness * (center - angle) - damping * velocity, a plain torque
+ * stream just leaves stiffness and damping at 0. center is a shaft angle (rad) as reported in the knob events.
+ * received is the micros() the comms thread got the frame at, for the latency counters.
+ */
+typedef struct {
+    float torque;
+    float center;
+    float stiffness;
+    float damping;
+    uint16_t seq;
+    uint32_t received;
+} StreamSetpoint;
+
+#define STREAM_TIMEOUT_US 20000 // default watchdog, the profile haptics take over when no setpoint arrives for this long
+
+#define DETENT_EVENT_RING_SIZE 32
+#define SCOPE_BUFFER_SIZE 1024
+
+typedef enum : uint8_t {
+    SCOPE_TRIGGER_NONE = 0,     // Start capturing right away
+    SCOPE_TRIGGER_DETENT = 1,   // Start capturing on the next detent change
+    SCOPE_TRIGGER_LIMIT = 2     // Start capturing when an endstop is hit
+} ScopeTrigger;
+
+typedef enum : uint8_t {
+    SCOPE_IDLE = 0,
+    SCOPE_ARMED = 1,
+    SCOPE_CAPTURING = 2,
+    SCOPE_DONE = 3
+} ScopeState;
+
+/**
+ * One haptic loop iteration as recorded by the scope, timestamp is in microseconds since the trigger.
+ */
+typedef struct {
+    uint32_t timestamp;
+    float angle;
+    float velocity;
+    float attract_angle;
+    float error;
+    float output;
+} ScopeSample;
+
+
 class FocThread : public Thread<FocThread> {
     friend class Thread<FocThread>; //Allow Base Thread to invoke protected run()
     friend class HapticInterface;
@@ -21,31 +120,137 @@ class FocThread : public Thread<FocThread> {
         void put_motor_command(String* msg);
         void put_haptic_config(DetentProfile& profile);
         bool get_angle_event(AngleEvt* evt);
-    
+        bool get_detent_event(DetentEvt* evt);
+        void put_detent_event(HapticEvt type, int32_t pos);
+        bool get_loop_stats(LoopStats* stats);
+        HapticSnapshot get_snapshot();
+        void set_angle_event_decimation(float min_angle, uint32_t min_microseconds);
+
+        bool arm_scope(ScopeTrigger trigger, uint16_t decimation);
+        bool disarm_scope();
+        ScopeState get_scope_state();
+        const ScopeSample* get_scope_samples();
+
+        void start_stream(uint32_t timeout_us);
+        void stop_stream();
+        void put_stream_setpoint(const StreamSetpoint& setpoint);
+        bool is_streaming();
+
+        void play_effect(HapticEffect effect, uint8_t strength);
+
+        bool play_clip(const String& name, uint8_t strength);
+        bool record_clip(const String& name, uint16_t rate);
+        void stop_clip();
+        void service_clip();
+        bool write_clip(const String& name, uint16_t rate, JsonArray samples, bool append);
+        ClipState get_clip_state();
+        const String& get_clip_name();
+
 
         float get_motor_angle();
         
         uint16_t pass_actual_pos();
-        uint16_t pass_cur_pos();
+        int32_t pass_cur_pos();
         uint16_t pass_start_pos();
         uint16_t pass_end_pos();
-        uint16_t pass_last_pos();
+        int32_t pass_last_pos();
         bool pass_at_limit();
 
         void setCalibration(MotorCalibration& cal);
+        void setCalibration(AnticoggingTable& table);
+        void setCalibration(EncoderCalibration& cal);
+        void setCalibration(PidTuning& tuning);
 
     protected:
         void run();
         void handleMessage();
         void handleHapticConfig();
+        void handleHousekeeping();
+        void updateLoopStats(uint32_t overruns);
+        void publishLoopStats();
+        void resetLoopStats();
+        void publishSnapshot();
+        void captureScope();
+        bool handleStream();
+        void handleEffects();
+        void handleClip();
+        void handleClipRecording();
 
-        float angleEventMinAngle = 0.017453292519943f; // 1° in radians
-        uint32_t angleEventMinMicroseconds = 10000; // 100Hz
+        // set by the comms thread, see set_angle_event_decimation()
+        std::atomic<float> angleEventMinAngle { 0.017453292519943f }; // 1° in radians
+        std::atomic<uint32_t> angleEventMinMicroseconds { 10000 }; // 100Hz
 
     private:
         QueueHandle_t _q_motor_in;
-        QueueHandle_t _q_haptic_in;
         QueueHandle_t _q_angleevt_out;
+        QueueHandle_t _q_loopstats_out;
+
+        Seqlock<HapticSnapshot> snapshot;
+
+        // haptic states are built by the comms thread and swapped in by the FOC thread
+        TripleBuffer<HapticState> haptic_states;
+        std::atomic<bool> motor_command_pending { false };
+
+        // detent events, pushed from the haptic loop and dispatched by the HMI thread
+        SpscRing<DetentEvt, DETENT_EVENT_RING_SIZE> detent_events;
+
+        // torque clips, the comms thread moves them to and from SPIFFS, the FOC thread plays and records them
+        HapticClip clip;
+        HapticEvt last_detent_event = HapticEvt::EITHER;
+
+        int32_t serial_last_pos = 0;
+        float event_last_angle = 0.0f;
+        unsigned long event_last_ts = 0;
+
+        // scope capture, armed by the comms thread, filled by the FOC thread and dumped once done
+        ScopeSample scope_samples[SCOPE_BUFFER_SIZE];
+        std::atomic<uint8_t> scope_state { SCOPE_IDLE };
+        std::atomic<uint8_t> scope_trigger { SCOPE_TRIGGER_NONE };
+        std::atomic<uint16_t> scope_decimation { 1 };
+        uint16_t scope_count = 0;
+        uint16_t scope_skip = 0;
+        int32_t scope_last_pos = 0;
+        unsigned long scope_start = 0;
+
+        // effect trigger mailbox, strength << 8 | effect, 0 when empty, written from any thread
+        std::atomic<uint16_t> effect_request { 0 };
+
+        // host streaming, the setpoint slot is written by the comms thread and polled by the FOC thread
+        Seqlock<StreamSetpoint> stream_slot;
+        std::atomic<bool> stream_enabled { false };
+        std::atomic<bool> stream_active { false };
+        std::atomic<uint32_t> stream_timeout { STREAM_TIMEOUT_US };
+        StreamSetpoint stream_setpoint;
+        uint32_t stream_version = 0;
+        unsigned long stream_last_frame = 0;
+        uint32_t stats_stream_frames = 0;
+        uint32_t stats_stream_latency_sum = 0;
+        uint32_t stats_stream_latency_max = 0;
+        uint32_t stats_stream_timeouts = 0;
+
+        // loop timing, only touched by the FOC thread
+        float cycles_to_us;
+        uint32_t stats_last_cycles = 0;
+        uint32_t stats_nominal_cycles = 0;
+        uint32_t stats_min_cycles;
+        uint32_t stats_max_cycles;
+        uint64_t stats_sum_cycles;
+        uint32_t stats_loops;
+        uint32_t stats_overruns;
+        uint32_t stats_jitter[LOOP_JITTER_BUCKETS];
+        uint32_t stats_sensor_reads;
+        uint64_t stats_sensor_age;
+        uint64_t stats_haptic_cycles;
+        uint32_t stats_haptic_cycles_max;
+        uint32_t stats_haptic_loops;
+        float stats_predict_lead;
+        uint32_t stats_prediction_checks;
+        float stats_prediction_error;
+        float stats_prediction_error_max;
+        float stats_prediction_baseline;
+        float predict_compute_us = 0.0f; // from the sensor sample until the haptic loop applied its output, last iteration
+        uint32_t prediction_checks_seen = 0;
+        unsigned long stats_window_start;
 };
 
 extern FocThread foc_thread;
@@ -13,6 +13,7 @@
 
 
 PIDController default_pid(5.0, 0.0, 0.004, 10000, 0.4);
+Seqlock<PidTuning> pid_tuning;
 
 DetentProfile default_profile{
     .mode = HapticMode::REGULAR,
@@ -55,33 +56,226 @@ HapticState::HapticState(DetentProfile profile){
     load_profile(profile, profile.start_pos);
 };
 
-HapticState::HapticState(DetentProfile profile, uint16_t position){
+HapticState::HapticState(DetentProfile profile, int32_t position){
     load_profile(profile, position);
 };
 
-void HapticState::load_profile(DetentProfile profile, uint16_t new_position = 0xFFFF){
+void HapticState::load_profile(DetentProfile profile, int32_t new_position = INT32_MIN){
     
-    uint16_t isVernier = profile.mode == HapticMode::VERNIER ? profile.vernier : 1;
-   
-    num_detents = profile.end_pos - profile.start_pos;
+    int32_t isVernier = profile.mode == HapticMode::VERNIER ? profile.vernier : 1;
+
+    // Bounds are resolved here in 32 bit, the detent handler only compares against them.
+    // Endless mode just opens them up to the full range, so it costs nothing per detent.
+    if(profile.endless){
+        min_pos = INT32_MIN;
+        max_pos = INT32_MAX;
+    }
+    else{
+        min_pos = (int32_t)profile.start_pos * isVernier;
+        max_pos = (int32_t)profile.end_pos * isVernier;
+    }
+
     detent_width = _2PI / profile.detent_count;
 
     if(profile.mode == HapticMode::VERNIER)
         detent_width /= profile.vernier;
 
-    if(new_position != 0xFFFF)
+    if(new_position != INT32_MIN)
         current_pos = new_position;
     else
     {
         // If no special handling of new position, check that we are in a valid region.
-        if(current_pos < profile.start_pos * isVernier)
-            current_pos = profile.start_pos;
-        else if(current_pos > profile.end_pos * isVernier)
-            current_pos = profile.end_pos;
+        if(current_pos < min_pos)
+            current_pos = min_pos;
+        else if(current_pos > max_pos)
+            current_pos = max_pos;
     }
 
     last_pos = current_pos;
     detent_profile = profile;
+
+    compile_texture();
+
+    // Pick the loop kernel here so the haptic loop doesn't branch on the mode every iteration.
+    switch(profile.mode){
+        case HapticMode::VISCOSE:
+            select_kernel<HapticMode::VISCOSE>();
+            break;
+        case HapticMode::SPRING:
+            select_kernel<HapticMode::SPRING>();
+            break;
+        case HapticMode::CURVE:
+            select_kernel<HapticMode::CURVE>();
+            break;
+        default:
+            // Vernier only differs in the compiled bounds and detent width
+            select_kernel<HapticMode::REGULAR>();
+            break;
+    }
+}
+
+/**
+ * Picks the loop kernel instantiations for the mode and the profile's hysteresis type, one per sensor direction,
+ * as the direction is only known once the motor is aligned and can change on a recalibration.
+*/
+template<HapticMode MODE>
+void HapticState::select_kernel(void)
+{
+    // Positions count the same way as the attractor angle with a CCW sensor on the production PCB, the other way round otherwise
+    if(detent_profile.kxForce){
+        kernel[0] = &HapticInterface::loop_kernel<MODE, true, !PRODUCTION_PCB>;
+        kernel[1] = &HapticInterface::loop_kernel<MODE, true, (bool)PRODUCTION_PCB>;
+    }
+    else{
+        kernel[0] = &HapticInterface::loop_kernel<MODE, false, !PRODUCTION_PCB>;
+        kernel[1] = &HapticInterface::loop_kernel<MODE, false, (bool)PRODUCTION_PCB>;
+    }
+}
+
+/**
+ * Precomputes the detent texture for the loaded profile, see DetentTexture.
+ * Called once per profile load, never from the haptic loop.
+*/
+void HapticState::compile_texture(void){
+    texture.inv_detent_width = 1.0 / detent_width;
+
+    if(!detent_profile.kxForce){
+        texture.hysteresis_scale_lo = 1.0;
+        texture.hysteresis_scale_hi = 1.0;
+        texture.hysteresis_band = detent_width * attract_hysteresis;
+    }
+    else{
+        // 0.15 is a correction factor to compensate for the large hysteresis in normal modes, to make the force per detent reasonable.
+        float detentHysteresis = 0.15 * attract_hysteresis * -1.0;
+        texture.hysteresis_scale_lo = 1.0 - detentHysteresis;
+        texture.hysteresis_scale_hi = 1.0 + detentHysteresis;
+        texture.hysteresis_band = 0.0;
+    }
+
+    // No D term unless the profile or the device tuning sets one
+    texture.d_gain = 0.0;
+
+    compile_gains();
+
+    if(detent_profile.mode == HapticMode::SPRING || detent_profile.mode == HapticMode::CURVE){
+        texture.stiffness = detent_profile.detent_strength * SPRING_STIFFNESS_UNIT;
+        // Near critical damping for the stiffness, c = 2 * sqrt(k * J), with k and c in motor target units
+        texture.damping = SPRING_DAMPING_RATIO * 2.0 * sqrtf(texture.stiffness * KNOB_INERTIA_PER_TORQUE);
+    }
+    else{
+        texture.damping = detent_profile.detent_strength * VISCOSE_DAMPING_UNIT;
+        texture.stiffness = 0.0;
+    }
+
+    // If the position error is small, reduce strength to prevent oscillation.
+    texture.error_threshold = detent_width * SNAP_ERROR_FRACTION;
+
+    compile_curve();
+    compile_glide();
+
+    texture.crossfade_rate = detent_profile.crossfade > 0 ? CROSSFADE_TABLE_SIZE / (detent_profile.crossfade * 1000.0) : 0.0;
+}
+
+/**
+ * Derives this profile's PID controller from the device base tuning and the profile overrides.
+ * The P gains for the detent, clipping and re-entry cases are tabulated, the D gain and output ramp
+ * are set once here, so correct_pid() only has to pick one.
+*/
+void HapticState::compile_gains(void){
+    // The comms thread compiles profiles too, take a consistent copy of the tuning
+    PidTuning tuning = pid_tuning.read();
+
+    if(detent_profile.pid_d > 0)
+        texture.d_gain = detent_profile.pid_d;
+    else if(tuning.valid)
+        texture.d_gain = tuning.d;
+
+    texture.p_gain[0] = detent_profile.pid_p > 0 ? detent_profile.pid_p : (tuning.valid ? tuning.p : detent_strength_unit);
+    texture.p_gain[1] = endstop_strength_unit;
+    // Re-entering bounds after an endstop, no P until the position settles
+    texture.p_gain[2] = 0.0;
+    texture.p_gain[3] = 0.0;
+    texture.settle_damping = 2.0 * sqrtf(texture.p_gain[0] * KNOB_INERTIA_PER_TORQUE);
+
+    pid = default_pid;
+    pid.P = texture.p_gain[0];
+    pid.D = texture.d_gain;
+    pid.output_ramp = detent_profile.output_ramp;
+    // The tuned ramp is the fastest this unit takes without ringing, profiles may only ask for slower
+    if(tuning.valid && (pid.output_ramp <= 0 || tuning.output_ramp < pid.output_ramp))
+        pid.output_ramp = tuning.output_ramp;
+    pid.reset();
+}
+
+/**
+ * Tabulates the velocity to strength curve, a smoothstep from full strength at glide_start
+ * down to glide_floor at glide_end. The loop interpolates it, beyond glide_end the last entry holds.
+*/
+void HapticState::compile_glide(void){
+    float start = detent_profile.glide_start;
+    float end = detent_profile.glide_end;
+    float floor = CLAMP(detent_profile.glide_floor, 0.0f, 1.0f);
+
+    if(end <= 0.0){
+        start = end = GLIDE_DEFAULT_VELOCITY;
+        floor = 0.0;
+    }
+    start = CLAMP(start, 0.0f, end);
+
+    texture.inv_velocity_step = VELOCITY_TABLE_SIZE / end;
+    for(uint16_t i = 0; i <= VELOCITY_TABLE_SIZE; i++){
+        float v = end * i / VELOCITY_TABLE_SIZE;
+        float t = end > start ? CLAMP((v - start) / (end - start), 0.0f, 1.0f) : (v >= end ? 1.0f : 0.0f);
+        texture.velocity_gain[i] = 1.0 - (1.0 - floor) * t * t * (3.0 - 2.0 * t);
+    }
+}
+
+/**
+ * Samples a Catmull-Rom spline through the curve control points into the Q15 curve table.
+ * Outside the first and last point the force stays flat. Without at least two points the table is zero,
+ * the knob is then smooth apart from the endstops.
+*/
+void HapticState::compile_curve(void){
+    uint8_t n = min(detent_profile.curve_points, (uint8_t)CURVE_MAX_POINTS);
+    texture.curve_scale = detent_profile.detent_strength * CURVE_STRENGTH_UNIT / 32767.0;
+
+    if(detent_profile.mode != HapticMode::CURVE || n < 2){
+        memset(texture.curve, 0, sizeof(texture.curve));
+        return;
+    }
+
+    float x[CURVE_MAX_POINTS], f[CURVE_MAX_POINTS];
+    for(uint8_t k = 0; k < n; k++){
+        x[k] = detent_profile.curve[k][0] / 254.0;
+        f[k] = detent_profile.curve[k][1] / 127.0;
+    }
+
+    uint8_t seg = 0;
+    for(uint16_t i = 0; i <= CURVE_LUT_SIZE; i++){
+        float xi = (float)i / CURVE_LUT_SIZE - 0.5;
+        float value;
+
+        while(seg < n - 2 && xi > x[seg + 1])
+            seg++;
+
+        if(xi <= x[0])
+            value = f[0];
+        else if(xi >= x[n - 1])
+            value = f[n - 1];
+        else{
+            float x0 = x[seg], x1 = x[seg + 1];
+            float h = x1 - x0;
+            float t = h > 0 ? (xi - x0) / h : 0.0;
+            // Tangents from the neighbouring points, one sided at the ends
+            float m0 = seg > 0 ? (f[seg + 1] - f[seg - 1]) / (x1 - x[seg - 1]) : (f[seg + 1] - f[seg]) / h;
+            float m1 = seg < n - 2 ? (f[seg + 2] - f[seg]) / (x[seg + 2] - x0) : (f[seg + 1] - f[seg]) / h;
+            float t2 = t * t, t3 = t2 * t;
+            value = (2 * t3 - 3 * t2 + 1) * f[seg] + (t3 - 2 * t2 + t) * h * m0
+                + (-2 * t3 + 3 * t2) * f[seg + 1] + (t3 - t2) * h * m1;
+        }
+
+        texture.curve[i] = (int16_t)roundf(CLAMP(value, -1.0f, 1.0f) * 32767);
+    }
 }
 
 HapticState::~HapticState() {};
@@ -89,69 +283,235 @@ HapticState::~HapticState() {};
 HapticInterface::HapticInterface(BLDCMotor* _motor){
     motor = _motor;
     haptic_pid = &default_pid;
-    haptic_state = HapticState(default_profile);
+    haptic_state = nullptr;
 };
 
 HapticInterface::HapticInterface(BLDCMotor* _motor, PIDController* _pid){
     motor = _motor;
     haptic_pid = _pid;
-    haptic_state = HapticState(default_profile);
+    haptic_state = nullptr;
 };
 
 void HapticInterface::init(void){
     motor->velocity_limit = 10000;
     motor->controller = MotionControlType::torque;
     motor->foc_modulation = FOCModulationType::SpaceVectorPWM;
+    build_effects();
+    build_crossfade();
 };
 
+void HapticInterface::build_crossfade(void)
+{
+    for(uint16_t i = 0; i <= CROSSFADE_TABLE_SIZE; i++){
+        float t = (float)i / CROSSFADE_TABLE_SIZE;
+        crossfade[i] = t * t * (3.0 - 2.0 * t);
+    }
+}
+
+/**
+ * Fills the effect table. The waveforms are balanced, each pushes as much as it pulls,
+ * so playing them doesn't move the knob off its detent.
+*/
+void HapticInterface::build_effects(void)
+{
+    const float dt = 1.0 / EFFECT_SAMPLE_RATE;
+    memset(effects, 0, sizeof(effects));
+
+    // 1ms push and 1ms pull
+    EffectWaveform& click = effects[HapticEffect::EFFECT_CLICK];
+    click.length = EFFECT_SAMPLE_RATE / 500;
+    for(uint16_t i = 0; i < click.length; i++)
+        click.samples[i] = i < click.length / 2 ? 127 : -127;
+
+    // 170Hz, faded in and out over 5ms
+    EffectWaveform& buzz = effects[HapticEffect::EFFECT_BUZZ];
+    buzz.length = EFFECT_SAMPLE_RATE * 60 / 1000;
+    for(uint16_t i = 0; i < buzz.length; i++){
+        float fade = min(1.0f, min(i, (uint16_t)(buzz.length - i)) * dt / 0.005f);
+        buzz.samples[i] = (int8_t)(127 * fade * sinf(_2PI * 170 * i * dt));
+    }
+
+    EffectWaveform& tap = effects[HapticEffect::EFFECT_DOUBLE_TAP];
+    uint16_t gap = EFFECT_SAMPLE_RATE * 40 / 1000;
+    tap.length = gap + click.length;
+    memcpy(tap.samples, click.samples, click.length);
+    memcpy(tap.samples + gap, click.samples, click.length);
+
+    EffectWaveform& ramp = effects[HapticEffect::EFFECT_RAMP];
+    ramp.length = EFFECT_MAX_SAMPLES;
+    for(uint16_t i = 0; i < ramp.length; i++)
+        ramp.samples[i] = (int8_t)(127 * ((float)i / ramp.length) * sinf(_2PI * 170 * i * dt));
+
+    // One 50Hz period
+    EffectWaveform& bump = effects[HapticEffect::EFFECT_BUMP];
+    bump.length = EFFECT_SAMPLE_RATE / 50;
+    for(uint16_t i = 0; i < bump.length; i++)
+        bump.samples[i] = (int8_t)(127 * sinf(_2PI * i / bump.length));
+}
+
+/**
+ * Starts playing an effect from the table, strength 255 peaks at the haptic output limit.
+ * A running effect is replaced. Only call from the FOC thread.
+*/
+void HapticInterface::start_effect(HapticEffect effect, uint8_t strength)
+{
+    if(effect == HapticEffect::EFFECT_NONE || effect >= HAPTIC_EFFECT_COUNT || effects[effect].length == 0)
+        return;
+    effect_playing = &effects[effect];
+    effect_start = micros();
+    effect_gain = haptic_state->pid.limit * strength / (255.0 * 127.0);
+}
+
 void HapticInterface::haptic_loop(void){
+    (this->*haptic_state->kernel[motor->sensor_direction == Direction::CCW])();
+}
+
+/**
+ * One haptic loop iteration for a mode, hysteresis type and count direction. Each combination is its own
+ * instantiation, selected when the profile loads, so the iteration runs straight through with the
+ * branches on them folded away at compile time.
+*/
+template<HapticMode MODE, bool KX_FORCE, bool ALIGNED>
+void HapticInterface::loop_kernel(void)
+{
+    predict_angle(); // Shaft angle at the time the output gets applied
     correct_pid(); // Adjust PID (Derivative Gain)
-    find_detent(); // Calculate attraction angle depending on configured distance position.
-    haptic_target(); // PID Command
+    if(haptic_state->boundsSettling){
+        bounds_handler<ALIGNED>(haptic_state->detent_width); // Settle step, detents are paused until the knob is back in bounds
+        return;
+    }
+    find_detent<KX_FORCE, ALIGNED>(); // Calculate attraction angle depending on configured distance position.
+
+    switch(MODE){
+        case HapticMode::VISCOSE:
+            viscose_target();
+            break;
+        case HapticMode::SPRING:
+            spring_target<ALIGNED>();
+            break;
+        case HapticMode::CURVE:
+            curve_target<ALIGNED>();
+            break;
+        default:
+            haptic_target<ALIGNED>(); // PID Command
+            break;
+    }
 }
 
 /**
- * Handles scaling the P term error and clamping error to prevent overshoot.
- * The scaled P error helps to prevent steady state error due to lack of I term (for "rolling" reasons).
- * When roll mode is triggered, I term is added back in.
+ * Bypasses the detents and drives the given torque, clamped to the haptic output limit.
+ * Used by the host streaming mode, the anticogging feedforward still applies.
 */
-void HapticInterface::correct_pid(void)
+void HapticInterface::direct_loop(float torque)
 {
-    bool clipping;
-
-    // Derivative upper and lower strength are very small
-    float d_lower_strength = haptic_state.detent_strength_unit * 0.008;
-    float d_upper_strength = haptic_state.detent_strength_unit * 0.004;
-    float d_lower_pos_width = radians(3);
-    float d_upper_pos_width = radians(8);
-    float raw = d_lower_strength;
-    raw += (d_upper_strength - d_lower_strength)/(d_upper_pos_width - d_lower_pos_width);
-    raw *= haptic_state.detent_width - d_lower_pos_width;
-    
+    drive(0.0, CLAMP(torque, -haptic_state->pid.limit, haptic_state->pid.limit));
+}
 
-    uint16_t total_positions = haptic_state.detent_profile.end_pos - haptic_state.detent_profile.start_pos + 1;
-    // If the error is large, clamp the D term so we don't overdrive the response.
-    haptic_pid->D = total_positions > 0 ? 0 : CLAMP(
-        raw,
-        min(d_lower_strength, d_upper_strength),
-        max(d_lower_strength, d_upper_strength)
-    );
+/**
+ * Puts the detents back at the current knob angle after it was driven by something else,
+ * keeping the position. Otherwise the attractor would snap to wherever the knob ended up.
+*/
+void HapticInterface::reanchor(void)
+{
+    haptic_state->attract_angle = roundf(motor->shaft_angle * haptic_state->texture.inv_detent_width) * haptic_state->detent_width;
+    haptic_state->last_attract_angle = haptic_state->attract_angle;
+    haptic_state->atLimit = false;
+    haptic_state->wasAtLimit = false;
+    haptic_state->boundsSettling = false;
+    haptic_state->pid.reset();
+}
 
-    // Check if within range and apply voltage/current limit.
-    if (haptic_state.attract_angle <= haptic_state.last_attract_angle - haptic_state.detent_width)
-        clipping = true;
+/**
+ * Remembers the current haptic state's attractor, position and bounds for switch_state().
+ * Call while the current state is still valid, before the new one replaces it.
+*/
+void HapticInterface::capture_state(void)
+{
+    fade_pid = haptic_state->pid;
+    fade_angle = haptic_state->last_attract_angle;
+    fade_pos = haptic_state->current_pos;
+    fade_min_pos = haptic_state->min_pos;
+    fade_max_pos = haptic_state->max_pos;
+    fade_endless = haptic_state->detent_profile.endless;
+}
 
-    else if (haptic_state.attract_angle >= haptic_state.last_attract_angle + haptic_state.detent_width)
-        clipping = true;
+/**
+ * Switches to a new haptic state without a jolt. The knob keeps its angle, the position captured by capture_state()
+ * is remapped into the new range and the new detents are anchored where the knob is. Over the new profile's crossfade
+ * time drive() then blends from the previous attractor to the new kernel.
+*/
+void HapticInterface::switch_state(HapticState* state)
+{
+    int32_t pos = fade_pos;
+    // Same fraction of the range, endless positions are kept as they are
+    if(!fade_endless && !state->detent_profile.endless){
+        int64_t from_span = (int64_t)fade_max_pos - fade_min_pos;
+        int64_t to_span = (int64_t)state->max_pos - state->min_pos;
+        pos = from_span > 0 ? state->min_pos + ((int64_t)pos - fade_min_pos) * to_span / from_span : state->min_pos;
+    }
+    state->current_pos = CLAMP(pos, state->min_pos, state->max_pos);
+    state->last_pos = state->current_pos;
 
-    else
-        clipping = false;
+    haptic_state = state;
+    reanchor();
 
-    haptic_pid->P = clipping ? haptic_state.endstop_strength_unit : haptic_state.detent_strength_unit;
-    
-    
-    if(haptic_state.wasAtLimit)
-    haptic_pid->P = 0;
+    // The previous controller carries on where it was, so the torque doesn't step
+    fade_start = micros();
+    fading = state->texture.crossfade_rate > 0;
+}
+
+/**
+ * Extrapolates the shaft angle by predict_lead with the velocity and a smoothed acceleration, so the detents
+ * act on where the knob is when the output gets applied rather than where it was when the sensor latched it.
+ * For the telemetry one extrapolation at a time is kept until its lead has passed, then checked against the
+ * measured angle interpolated to that time.
+*/
+void HapticInterface::predict_angle(void)
+{
+    unsigned long now = micros();
+    float dt = (now - predict_ts) * 1e-6f;
+    float velocity = motor->shaft_velocity;
+
+    // Skip the derivatives across pauses, e.g. the first iteration or after a calibration
+    if(dt > 0.0f && dt < 0.01f){
+        if(check_pending && (long)(now - check_ts) >= 0){
+            // The check is due between the previous iteration and this one
+            float measured = predict_angle_prev + (motor->shaft_angle - predict_angle_prev) * ((check_ts - predict_ts) * 1e-6f / dt);
+            prediction_error = check_predicted - measured;
+            prediction_baseline = check_sampled - measured;
+            prediction_checks++;
+            check_pending = false;
+        }
+        predict_accel += ((velocity - predict_velocity) / dt - predict_accel) * PREDICT_ACCEL_ALPHA;
+    }
+    else{
+        predict_accel = 0.0;
+        check_pending = false;
+    }
+
+    predict_ts = now;
+    predict_angle_prev = motor->shaft_angle;
+    predict_velocity = velocity;
+    predicted_angle = motor->shaft_angle + (velocity + 0.5f * predict_accel * predict_lead) * predict_lead;
+
+    if(!check_pending){
+        check_ts = now + (unsigned long)(predict_lead * 1e6f);
+        check_predicted = predicted_angle;
+        check_sampled = motor->shaft_angle;
+        check_pending = true;
+    }
+}
+
+/**
+ * Handles scaling the P term error and clamping error to prevent overshoot.
+ * The scaled P error helps to prevent steady state error due to lack of I term (for "rolling" reasons).
+ * When roll mode is triggered, I term is added back in.
+*/
+void HapticInterface::correct_pid(void)
+{
+    // Check if within range and apply voltage/current limit, the gains come precompiled with the profile.
+    bool clipping = fabsf(haptic_state->attract_angle - haptic_state->last_attract_angle) >= haptic_state->detent_width;
+    haptic_state->pid.P = haptic_state->texture.p_gain[haptic_state->wasAtLimit << 1 | clipping];
 }
 
 /** 
@@ -159,8 +519,9 @@ void HapticInterface::correct_pid(void)
 */
 void HapticInterface::offset_detent(void){
     motor->sensor_offset = motor->shaft_angle;
-    haptic_state.attract_angle = 0.0;
-    haptic_state.last_attract_angle = 0.0;
+    check_pending = false; // The pending extrapolation is in the previous offset
+    haptic_state->attract_angle = 0.0;
+    haptic_state->last_attract_angle = 0.0;
 }
 
 /**
@@ -172,146 +533,93 @@ void HapticInterface::offset_detent(void){
  * Separate positive and negative error so that we can have asymmetric haptic textures.
  * Use this for when your fine and coarse detents are straddling the current detent.
 */
+template<bool KX_FORCE, bool ALIGNED>
 void HapticInterface::find_detent(void)
 {
     /**
-     * hysteresisType is used to handle whether the detents are linear in strength or progressively stronger.
-     * We then generate new bounds for the detent based on the hysteresis (as a percentage)
+     * The hysteresis bounds around the current attractor come precompiled with the profile,
+     * linear for regular detents or progressively stronger for kxForce.
     */
-    float detentHysteresis;
-    float minHysteresis;
-    float maxHysteresis;
-
-    // Special handling for progressive force modes.
-    if(!haptic_state.detent_profile.kxForce){
-        detentHysteresis = haptic_state.detent_width * haptic_state.attract_hysteresis;
-        minHysteresis = haptic_state.attract_angle - detentHysteresis;
-        maxHysteresis = haptic_state.attract_angle + detentHysteresis;
+    float minHysteresis, maxHysteresis;
+    if(KX_FORCE){
+        minHysteresis = haptic_state->attract_angle * haptic_state->texture.hysteresis_scale_lo;
+        maxHysteresis = haptic_state->attract_angle * haptic_state->texture.hysteresis_scale_hi;
     }
     else{
-        // 0.1 is a correction factor to compensate for the large hysteresis in normal modes, to make the force per detent reasonable.
-        detentHysteresis = 0.15 * haptic_state.attract_hysteresis * -1.0;
-        minHysteresis = haptic_state.attract_angle * (1.0 - detentHysteresis);
-        maxHysteresis = haptic_state.attract_angle * (1.0 + detentHysteresis);
+        minHysteresis = haptic_state->attract_angle - haptic_state->texture.hysteresis_band;
+        maxHysteresis = haptic_state->attract_angle + haptic_state->texture.hysteresis_band;
     }
 
-    if(motor->shaft_angle < minHysteresis){
-        // Knob is turned less than detent (left half of texture graph)
-        haptic_state.attract_angle = round(motor->shaft_angle / haptic_state.detent_width); 
-        haptic_state.attract_angle *= haptic_state.detent_width;
-    }
-    else if(motor->shaft_angle > maxHysteresis){
-        // Knob is turned more than detent (right half of texture graph)
-        haptic_state.attract_angle = round(motor->shaft_angle / haptic_state.detent_width);
-        haptic_state.attract_angle *= haptic_state.detent_width;
+    // Knob is turned less (left half of texture graph) or more (right half) than the detent
+    if(predicted_angle < minHysteresis || predicted_angle > maxHysteresis){
+        haptic_state->attract_angle = roundf(predicted_angle * haptic_state->texture.inv_detent_width);
+        haptic_state->attract_angle *= haptic_state->detent_width;
     }
 
     // If there has been a change in the haptic attractor
-    if(haptic_state.last_attract_angle != haptic_state.attract_angle){
-        detent_handler();
+    if(haptic_state->last_attract_angle != haptic_state->attract_angle){
+        detent_handler<ALIGNED>();
     }
 }
 
 /**
  * If there has been an update in the physical location of the detent, this function helps handle
  * the abstraction in terms of detent index and firing off HapticEventCallback.
+ * ALIGNED is set when positions count up as the attractor angle goes up, see HapticState::select_kernel().
 */
+template<bool ALIGNED>
 void HapticInterface::detent_handler(void){
-    // Logic for handling detent update events.
-    uint16_t effective_start_pos = haptic_state.detent_profile.start_pos;
-    uint16_t effective_end_pos = haptic_state.detent_profile.end_pos;
-
-    if(haptic_state.detent_profile.mode == HapticMode::VERNIER){
-        effective_start_pos *= haptic_state.detent_profile.vernier;
-        effective_end_pos *= haptic_state.detent_profile.vernier;
-    }
+    // Logic for handling detent update events, bounds come precomputed with the profile.
+    bool attract_up = haptic_state->last_attract_angle < haptic_state->attract_angle;
 
     // Check if we are increasing or decreasing detent
-    if(haptic_state.last_attract_angle > haptic_state.attract_angle){
-
-        #if PRODUCTION_PCB
-        if(motor->sensor_direction == Direction::CCW){
-        #else 
-        if(motor->sensor_direction != Direction::CCW){
-        #endif
-            // Check that we are at limit
-            if(haptic_state.current_pos > effective_start_pos){
-                if(haptic_state.atLimit)
-                    haptic_state.wasAtLimit = true;
-
-                haptic_state.atLimit = false;
-                haptic_state.current_pos--;
-                haptic_state.last_attract_angle = haptic_state.attract_angle;
-
-                HapticEventCallback(HapticEvt::DECREASE);
-            }
-            else{
-                HapticEventCallback(HapticEvt::LIMIT_NEG);  
-                haptic_state.atLimit = true;
+    if(attract_up == ALIGNED){
+        // Check if we are at limit
+        if(haptic_state->current_pos < haptic_state->max_pos){
+            if(haptic_state->atLimit){
+                haptic_state->wasAtLimit = true;
+                haptic_state->settle_angle = haptic_state->last_attract_angle;
             }
+
+            haptic_state->atLimit = false;
+            haptic_state->current_pos++;
+            haptic_state->last_attract_angle = haptic_state->attract_angle;
+
+            HapticEventCallback(HapticEvt::INCREASE);
         }
         else{
-            // Check that we are at limit
-            if(haptic_state.current_pos < effective_end_pos){
-                if(haptic_state.atLimit)
-                    haptic_state.wasAtLimit = true;
-                                   
-                haptic_state.atLimit = false;
-                haptic_state.current_pos++;
-                haptic_state.last_attract_angle = haptic_state.attract_angle;
-
-                HapticEventCallback(HapticEvt::INCREASE);
-            }
-            else{
-                HapticEventCallback(HapticEvt::LIMIT_POS);  
-                haptic_state.atLimit = true;
-            }
+            if(!haptic_state->atLimit)
+                start_effect(haptic_state->detent_profile.limit_effect, 255);
+            HapticEventCallback(HapticEvt::LIMIT_POS);
+            haptic_state->atLimit = true;
+            // Only this endstop clears the re-entry flag when positions follow the angle
+            if(ALIGNED)
+                haptic_state->wasAtLimit = false;
         }
-    
     }
     else{
-        #if PRODUCTION_PCB
-        if(motor->sensor_direction == Direction::CCW){
-        #else
-        if(motor->sensor_direction != Direction::CCW){
-        #endif
-            // Check if we are at limit
-            if(haptic_state.current_pos < effective_end_pos){
-                if(haptic_state.atLimit)
-                    haptic_state.wasAtLimit = true;
-                    
-                haptic_state.atLimit = false; 
-                haptic_state.current_pos++;   
-                haptic_state.last_attract_angle = haptic_state.attract_angle;
-
-                HapticEventCallback(HapticEvt::INCREASE);
+        // Check that we are at limit
+        if(haptic_state->current_pos > haptic_state->min_pos){
+            if(haptic_state->atLimit){
+                haptic_state->wasAtLimit = true;
+                haptic_state->settle_angle = haptic_state->last_attract_angle;
             }
-            else{
-                HapticEventCallback(HapticEvt::LIMIT_POS);
-                haptic_state.atLimit = true;
-                haptic_state.wasAtLimit = false;
-            }
-        }
-        else{
-            // Check if we are at limit
-            if(haptic_state.current_pos > effective_start_pos){
-                if(haptic_state.atLimit)
-                    haptic_state.wasAtLimit = true;
 
-                haptic_state.atLimit = false;  
-                haptic_state.current_pos--;  
-                haptic_state.last_attract_angle = haptic_state.attract_angle;
+            haptic_state->atLimit = false;
+            haptic_state->current_pos--;
+            haptic_state->last_attract_angle = haptic_state->attract_angle;
 
-                HapticEventCallback(HapticEvt::DECREASE);
-            }
-            else{
-                HapticEventCallback(HapticEvt::LIMIT_NEG);
-                haptic_state.atLimit = true;
-            }
+            HapticEventCallback(HapticEvt::DECREASE);
+        }
+        else{
+            if(!haptic_state->atLimit)
+                start_effect(haptic_state->detent_profile.limit_effect, 255);
+            HapticEventCallback(HapticEvt::LIMIT_NEG);
+            haptic_state->atLimit = true;
         }
     }
 
-    if (!haptic_state.atLimit){
+    if (!haptic_state->atLimit){
         HapticEventCallback(HapticEvt::EITHER);
     }
 }
@@ -319,81 +627,436 @@ void HapticInterface::detent_handler(void){
 /**
  * Handling the position error and limit to within a detent, as well as clearing wasAtLimit flag.
 */
+template<bool ALIGNED>
 void HapticInterface::haptic_target(void)
 {
-    float error = haptic_state.last_attract_angle - motor->shaft_angle;
-    float error_threshold = haptic_state.detent_width * 0.0075; // 0.75% gives good snap without ringing
-    // default_pid.output_ramp = haptic_state.detent_profile.output_ramp;
-    haptic_pid->output_ramp = haptic_state.detent_profile.output_ramp;
-     // Prevent knob velocity from getting too high and overshooting.
-    // If the position error is small, reduce strength to prevent oscillation
-    if(fabsf(error) < error_threshold)
-        error *= 0.75;
-
-    else if(fabsf(motor->shaft_velocity) > 30){
-
-        // Prevent knob velocity from getting too high and overshooting.
-        // Low values of this actually provide pretty interesting feeling where knob is smooth while 
-        // rotating quickly by hand but snappy during fine adjust.
-        error = 0.0;
-    }
-    else {
-        error = CLAMP(
-            error,
-            -haptic_state.detent_width,
-            haptic_state.detent_width
-        );
+    float error = haptic_state->last_attract_angle - predicted_angle;
+
+    if(fabsf(error) < haptic_state->texture.error_threshold){
+        // Close to the attractor, soften the error so the knob snaps in without ringing.
+        error *= SNAP_ERROR_GAIN;
+    }
+    else{
+        error = CLAMP(error, -haptic_state->detent_width, haptic_state->detent_width);
+
+        // Fade the detents out with the knob speed to prevent overshooting, fast spins glide while
+        // fine adjustments stay snappy. Table lookup, clamped to the last entry past glide_end.
+        float speed = min(fabsf(motor->shaft_velocity) * haptic_state->texture.inv_velocity_step, (float)VELOCITY_TABLE_SIZE);
+        uint16_t v = min((uint16_t)speed, (uint16_t)(VELOCITY_TABLE_SIZE - 1));
+        const float* velocity_gain = haptic_state->texture.velocity_gain;
+        error *= velocity_gain[v] + (velocity_gain[v + 1] - velocity_gain[v]) * (speed - v);
     }
 
     // When re-entering valid bounds, quickly try to get back to attract angle without involving haptics to prevent sliding into a further detent
-    if(!haptic_state.atLimit && haptic_state.wasAtLimit){
-        bounds_handler(haptic_state.detent_width);
+    if(!haptic_state->atLimit && haptic_state->wasAtLimit){
+        haptic_state->boundsSettling = true;
+        bounds_handler<ALIGNED>(haptic_state->detent_width);
     }
-    else
-        motor->loopFOC();
-        motor->move(default_pid(error));
+    else{
+        drive(error, haptic_state->pid(error));
+    }
+}
+
+/**
+ * Viscose kernel, the knob is smooth but resists motion proportionally to its velocity.
+ * Detents are still tracked for the position, only the endstops pull back like in regular mode.
+*/
+void HapticInterface::viscose_target(void)
+{
+    float error, torque;
+
+    if(haptic_state->atLimit){
+        error = haptic_state->last_attract_angle - predicted_angle;
+        torque = haptic_state->pid(error);
+    }
+    else{
+        error = -motor->shaft_velocity;
+        torque = CLAMP(haptic_state->texture.damping * error, -haptic_state->pid.limit, haptic_state->pid.limit);
+    }
+
+    // Nothing to slide into without detent forces, so re-entering bounds needs no settling.
+    haptic_state->wasAtLimit = false;
+
+    drive(error, torque);
 }
 
 /**
- * Handles the transition from out of bounds to in bounds movement 
- * to prevent overshooting by escaping from the haptic loop to settle the response.
+ * Spring kernel, the knob is pulled back towards spring_center with a force proportional to the displacement.
+ * The center angle follows from the tracked detent, so the spring survives profile reloads at any position.
 */
+template<bool ALIGNED>
+void HapticInterface::spring_target(void)
+{
+    const float direction = ALIGNED ? 1.0 : -1.0;
+
+    int32_t center_offset = (int32_t)haptic_state->detent_profile.spring_center - haptic_state->current_pos;
+    float center_angle = haptic_state->last_attract_angle + center_offset * haptic_state->detent_width * direction;
+
+    float torque = haptic_state->texture.stiffness * (center_angle - predicted_angle);
+    torque -= haptic_state->texture.damping * motor->shaft_velocity;
+    torque = CLAMP(torque, -haptic_state->pid.limit, haptic_state->pid.limit);
+
+    // The spring pulls back from the endstops by itself.
+    haptic_state->wasAtLimit = false;
+
+    drive(center_angle - predicted_angle, torque);
+}
+
+/**
+ * Curve kernel, the torque within the detent is looked up from the compiled curve table,
+ * a constant time lookup no matter how complex the curve. Detents are still tracked for the position,
+ * only the endstops pull back like in regular mode.
+*/
+template<bool ALIGNED>
+void HapticInterface::curve_target(void)
+{
+    float error, torque;
+
+    if(haptic_state->atLimit){
+        error = haptic_state->last_attract_angle - predicted_angle;
+        torque = haptic_state->pid(error);
+    }
+    else{
+        const float direction = ALIGNED ? 1.0 : -1.0;
+
+        // Position within the detent, -0.5..0.5 detent widths in the direction positions count up, maps onto the table
+        error = (predicted_angle - haptic_state->last_attract_angle) * haptic_state->texture.inv_detent_width * direction;
+        float offset = CLAMP((error + 0.5f) * CURVE_LUT_SIZE, 0.0f, (float)CURVE_LUT_SIZE);
+        uint16_t i = min((uint16_t)offset, (uint16_t)(CURVE_LUT_SIZE - 1));
+        float frac = offset - i;
+        const int16_t* curve = haptic_state->texture.curve;
+        torque = (curve[i] + (curve[i + 1] - curve[i]) * frac) * haptic_state->texture.curve_scale * direction;
+        torque -= haptic_state->texture.damping * motor->shaft_velocity;
+        torque = CLAMP(torque, -haptic_state->pid.limit, haptic_state->pid.limit);
+    }
+
+    // The curve shapes the endstop re-entry itself, no settling needed.
+    haptic_state->wasAtLimit = false;
+
+    drive(error, torque);
+}
+
+/**
+ * Handles the transition from out of bounds to in bounds movement to prevent overshooting
+ * by pausing the detents until the response settles on the endstop detent. Runs a single FOC step per haptic loop
+ * iteration, haptic_loop() keeps calling it while boundsSettling is set.
+*/
+template<bool ALIGNED>
 void HapticInterface::bounds_handler(float detent_width)
 {
-    float error = 0.0;
+    float error = haptic_state->settle_angle - predicted_angle;
 
-    while(fabsf(motor->shaft_velocity) > 1.0){
-        error = haptic_state.attract_angle - motor->shaft_angle;
-        // If you are driving the motor by hand, skip out of here so that you don't feel dragging on the knob
-        if(fabsf(error) > (detent_width * 2))
-            break;
+    // Settled once the knob stops on the detent, or skip out early if you are driving the motor by hand so that you don't feel dragging on the knob
+    bool settled = fabsf(motor->shaft_velocity) <= 1.0 && fabsf(error) < detent_width * SETTLE_BAND;
+    if(settled || fabsf(error) > (detent_width * 2)){
+        // Pick the detents up where the knob is now, counting the ones it crossed while they were paused.
+        // Never reached in endless mode, there are no endstops to re-enter from.
+        float rest_angle = roundf(predicted_angle * haptic_state->texture.inv_detent_width) * detent_width;
+        int32_t crossed = (int32_t)roundf((rest_angle - haptic_state->last_attract_angle) * haptic_state->texture.inv_detent_width);
+        int64_t pos = (int64_t)haptic_state->current_pos + (ALIGNED ? crossed : -crossed);
+        pos = CLAMP(pos, (int64_t)haptic_state->min_pos, (int64_t)haptic_state->max_pos);
+        HapticEvt step = pos > haptic_state->current_pos ? HapticEvt::INCREASE : HapticEvt::DECREASE;
+        while(haptic_state->current_pos != pos){
+            haptic_state->current_pos += step == HapticEvt::INCREASE ? 1 : -1;
+            HapticEventCallback(step);
+            HapticEventCallback(HapticEvt::EITHER);
+        }
+        haptic_state->attract_angle = rest_angle;
+        haptic_state->last_attract_angle = rest_angle;
 
-        motor->loopFOC();
-        motor->move(default_pid(error));
+        // Clear boundary exit flag
+        haptic_state->wasAtLimit = false;
+        haptic_state->boundsSettling = false;
     }
 
-    // Determine current boundary
-    if(haptic_state.current_pos <= haptic_state.num_detents / 2)
-        haptic_state.current_pos = haptic_state.detent_profile.start_pos;
-    else
-        haptic_state.current_pos = haptic_state.detent_profile.end_pos;
+    // correct_pid() drops P while wasAtLimit is set so the detents let go, the settle itself pulls back to the endstop
+    // detent, critically damped so the endstop spring doesn't throw the knob into the next detent.
+    haptic_state->pid.P = haptic_state->texture.p_gain[0];
+    float torque = haptic_state->pid(error) - haptic_state->texture.settle_damping * motor->shaft_velocity;
+    drive(error, CLAMP(torque, -haptic_state->pid.limit, haptic_state->pid.limit));
+}
 
-    // Correct position scaling if in vernier mode.
-    if(haptic_state.detent_profile.mode == HapticMode::VERNIER)
-        haptic_state.current_pos *= haptic_state.detent_profile.vernier;
+/**
+ * Runs the FOC step and applies the kernel output, keeping both around for telemetry.
+ * The anticogging feedforward, the playing effect and clip are added here, so every kernel gets them.
+*/
+void HapticInterface::drive(float error, float output)
+{
+    if(fading){
+        // Fresh after a profile switch, the previous attractor hands over to this kernel
+        float t = (micros() - fade_start) * haptic_state->texture.crossfade_rate;
+        if(t < CROSSFADE_TABLE_SIZE){
+            uint16_t i = (uint16_t)t;
+            float mix = crossfade[i] + (crossfade[i + 1] - crossfade[i]) * (t - i);
+            output = output * mix + fade_pid(fade_angle - predicted_angle) * (1.0f - mix);
+        }
+        else
+            fading = false;
+    }
 
-    // Fix physical drifting due to missing a detent when re-entering bounds.
-    if(haptic_state.current_pos <= haptic_state.num_detents / 2)
-        haptic_state.current_pos += 1;
-    else
-        haptic_state.current_pos -= 1;
+    kernel_output = output;
+
+    if(anticogging.valid){
+        uint16_t i = (uint16_t)(motor->sensor->getMechanicalAngle() * (ANTICOGGING_TABLE_SIZE / _2PI)) & (ANTICOGGING_TABLE_SIZE - 1);
+        output += anticogging.torque[i] * anticogging.scale * motor->sensor_direction;
+    }
+
+    if(effect_playing != nullptr){
+        uint32_t i = (micros() - effect_start) / (1000000 / EFFECT_SAMPLE_RATE);
+        if(i < effect_playing->length)
+            output += effect_playing->samples[i] * effect_gain;
+        else
+            effect_playing = nullptr;
+    }
+
+    output += clip_torque;
+
+    haptic_error = error;
+    haptic_output = output;
+    motor->loopFOC();
+    motor->move(output);
+}
+
+/**
+ * Stops the playing effect, clip and crossfade, so only the controller under test drives the motor
+ * through drive() while calibrating or tuning.
+*/
+void HapticInterface::clear_overlays(void)
+{
+    effect_playing = nullptr;
+    fading = false;
+    clip_torque = 0.0;
+}
+
+/**
+ * Holds the rotor at target for duration, if average is set it receives the mean torque it took,
+ * without the anticogging feedforward drive() adds.
+*/
+void HapticInterface::hold(PIDController& pid, float target, unsigned long duration, float* average)
+{
+    float sum = 0.0;
+    uint32_t samples = 0;
+    unsigned long start = micros();
+
+    while(micros() - start < duration){
+        float error = target - motor->shaft_angle;
+        float output = pid(error);
+        drive(error, output);
+        sum += output;
+        samples++;
+    }
+
+    if(average != nullptr)
+        *average = samples > 0 ? sum / samples : 0.0;
+}
+
+/**
+ * Builds the anticogging table. The rotor is stepped once around in both directions and held at every
+ * table position by a stiff PI loop, recording the average torque it takes. Averaging both directions
+ * cancels out the friction, what remains is the cogging torque, which drive() then feeds forward.
+ * Blocks for about 25 seconds, only call from the FOC thread.
+*/
+bool HapticInterface::calibrate_anticogging(void)
+{
+    const float step = _2PI / ANTICOGGING_TABLE_SIZE;
+    const unsigned long settle_us = 15000;
+    const unsigned long sample_us = 10000;
 
-    // Clear boundary exit flag
-    haptic_state.wasAtLimit = false;
+    PIDController hold_pid(10.0, 300.0, 0.0, 0, haptic_pid->limit);
+    float* sum = new float[ANTICOGGING_TABLE_SIZE]();
+    uint8_t* count = new uint8_t[ANTICOGGING_TABLE_SIZE]();
+
+    anticogging.valid = false;
+    clear_overlays();
+    float start = motor->shaft_angle;
+    hold(hold_pid, start, settle_us * 10, nullptr);
+
+    for(int pass = 0; pass < 2; pass++){
+        for(uint16_t n = 0; n <= ANTICOGGING_TABLE_SIZE; n++){
+            float target = start + (pass == 0 ? n : ANTICOGGING_TABLE_SIZE - n) * step;
+            float torque;
+            hold(hold_pid, target, settle_us, nullptr);
+            hold(hold_pid, target, sample_us, &torque);
+
+            uint16_t i = (uint16_t)(motor->sensor->getMechanicalAngle() / step) & (ANTICOGGING_TABLE_SIZE - 1);
+            sum[i] += torque * motor->sensor_direction;
+            count[i]++;
+        }
+    }
+
+    // Average the bins, bins missed by the sweep take the value of the previous one
+    float mean = 0.0;
+    uint16_t filled = 0;
+    for(uint16_t i = 0; i < ANTICOGGING_TABLE_SIZE; i++){
+        if(count[i] > 0){
+            sum[i] /= count[i];
+            mean += sum[i];
+            filled++;
+        }
+    }
+
+    bool ok = filled > ANTICOGGING_TABLE_SIZE / 2;
+    if(ok){
+        mean /= filled;
+        uint16_t last = 0;
+        while(count[last] == 0)
+            last++;
+        float peak = 0.0;
+        for(uint16_t i = 0; i < ANTICOGGING_TABLE_SIZE; i++){
+            if(count[i] == 0)
+                sum[i] = sum[last];
+            else
+                last = i;
+            peak = max(peak, fabsf(sum[i] - mean));
+        }
+
+        // Only the ripple is fed forward, a constant offset would just push the knob around
+        anticogging.scale = peak > 0 ? peak / 127.0 : 1.0;
+        for(uint16_t i = 0; i < ANTICOGGING_TABLE_SIZE; i++)
+            anticogging.torque[i] = (int8_t)roundf((sum[i] - mean) / anticogging.scale);
+        anticogging.valid = true;
+    }
+
+    delete[] sum;
+    delete[] count;
+    haptic_state->pid.reset();
+    return ok;
 }
+
+/**
+ * Steps the target from one angle to another and measures the response, after holding at the first
+ * angle long enough for the previous step to die out.
+*/
+void HapticInterface::step_response(PIDController& pid, float from, float to, StepResponse* response)
+{
+    const unsigned long hold_us = 100000;
+    const unsigned long duration_us = 150000;
+    const float step = to - from;
+
+    hold(pid, from, hold_us, nullptr);
+
+    bool rising = false, risen = false;
+    unsigned long t10 = 0, t90 = 0, outside = 0;
+    float peak = 0.0;
+    int side = 0;
+    *response = {};
+
+    unsigned long start = micros();
+    unsigned long now;
+    while((now = micros() - start) < duration_us){
+        // Same output path as the haptic loop, so the tune is measured with the anticogging feedforward
+        float target_error = to - motor->shaft_angle;
+        drive(target_error, pid(target_error));
+
+        float progress = (motor->shaft_angle - from) / step;
+        if(!rising && progress >= 0.1){ rising = true; t10 = now; }
+        if(!risen && progress >= 0.9){ risen = true; t90 = now; }
+        peak = max(peak, progress - 1.0f);
+
+        float error = progress - 1.0f;
+        if(fabsf(error) > 0.05)
+            outside = now;
+        if(fabsf(error) > 0.02){
+            int new_side = error > 0 ? 1 : -1;
+            if(side != 0 && new_side != side)
+                response->crossings++;
+            side = new_side;
+        }
+    }
+
+    response->rise_us = risen ? t90 - t10 : duration_us;
+    response->overshoot = peak;
+    response->settle_us = outside;
+    // Still moving in the last fifth of the window counts as not settled
+    response->settled = risen && outside < duration_us * 4 / 5;
+}
+
+/**
+ * Runs a step forth and back with the given controller, response receives the worse of the two.
+ * Acceptable is settled, at most 15% overshoot and at most one crossing of the target.
+*/
+bool HapticInterface::step_acceptable(PIDController& pid, float origin, StepResponse* response)
+{
+    const float step = 0.05; // rad, small enough to stay within one cogging period
+
+    StepResponse forth, back;
+    pid.reset();
+    step_response(pid, origin, origin + step, &forth);
+    step_response(pid, origin + step, origin, &back);
+
+    response->rise_us = max(forth.rise_us, back.rise_us);
+    response->overshoot = max(forth.overshoot, back.overshoot);
+    response->crossings = max(forth.crossings, back.crossings);
+    response->settle_us = max(forth.settle_us, back.settle_us);
+    response->settled = forth.settled && back.settled;
+
+    return response->settled && response->overshoot <= 0.15 && response->crossings <= 1;
+}
+
+/**
+ * Finds the stiffest PID tuning this unit takes without oscillating, using small position steps.
+ * P is raised until the response overshoots or rings and backed off by a margin, then D and the
+ * output ramp are picked for the fastest settling. The result goes to pid_tuning, profiles pick it
+ * up when they are next loaded. Blocks for about 10 seconds, only call from the FOC thread.
+*/
+bool HapticInterface::autotune(void)
+{
+    const float p_steps[] = { 1, 2, 3, 4, 6, 8, 10, 12, 16 };
+    const float d_steps[] = { 0.0, 0.002, 0.004, 0.006, 0.01 };
+    const float ramp_steps[] = { 1000, 3000, 10000, 30000 };
+    const float p_margin = 0.8;
+
+    PIDController pid(default_pid.P, 0.0, default_pid.D, default_pid.output_ramp, haptic_pid->limit);
+    StepResponse response;
+    float origin = motor->shaft_angle;
+    clear_overlays();
+
+    // Stiffness first, the highest P that still steps cleanly
+    float best_p = 0.0;
+    for(float p : p_steps){
+        pid.P = p;
+        if(!step_acceptable(pid, origin, &response))
+            break;
+        best_p = p;
+    }
+    if(best_p <= 0.0){
+        haptic_state->pid.reset();
+        return false;
+    }
+    pid.P = best_p * p_margin;
+
+    // Then damping, the fastest settling D
+    float best_d = pid.D;
+    float best_settle = INFINITY;
+    for(float d : d_steps){
+        pid.D = d;
+        if(step_acceptable(pid, origin, &response) && response.settle_us < best_settle){
+            best_settle = response.settle_us;
+            best_d = d;
+        }
+    }
+    pid.D = best_d;
+
+    // And the output ramp
+    float best_ramp = pid.output_ramp;
+    best_settle = INFINITY;
+    for(float ramp : ramp_steps){
+        pid.output_ramp = ramp;
+        if(step_acceptable(pid, origin, &response) && response.settle_us < best_settle){
+            best_settle = response.settle_us;
+            best_ramp = ramp;
+        }
+    }
+
+    pid_tuning.write(PidTuning{ .valid = true, .p = pid.P, .d = best_d, .output_ramp = best_ramp });
+
+    haptic_state->pid.reset();
+    return true;
+}
+
 // Internal detent update handler.
 void HapticInterface::HapticEventCallback(HapticEvt event){
-    UserHapticEventCallback(event, motor->shaft_angle, haptic_state.current_pos);
+    UserHapticEventCallback(event, motor->shaft_angle, haptic_state->current_pos);
 }
 
 // For user implementation
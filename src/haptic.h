@@ -6,6 +6,83 @@
 #include "encoders/mt6701/MagneticSensorMT6701SSI.h"
 #include <motor.h>
 #include "haptic_api.h"
+#include "seqlock.h"
+
+#define SNAP_ERROR_FRACTION 0.0075 // Errors within 0.75% of a detent are softened, gives good snap without ringing
+#define SNAP_ERROR_GAIN 0.75
+#define SETTLE_BAND 0.1 // Endstop re-entry has settled within this fraction of a detent from the endstop detent
+#define VISCOSE_DAMPING_UNIT 0.005 // Viscose torque per rad/s, per unit of detent_strength
+#define SPRING_STIFFNESS_UNIT 0.1 // Spring torque per rad of displacement, per unit of detent_strength
+#define SPRING_DAMPING_RATIO 1.0 // Fraction of critical damping for the spring, 1.0 returns as fast as possible without crossing the center
+#define KNOB_INERTIA_PER_TORQUE 1.6e-4 // Rotor and knob inertia over the motor torque constant (kg m^2 per Nm/A), 2208 motor with a 30g knob
+#define CURVE_STRENGTH_UNIT 0.1 // Curve torque at full scale, per unit of detent_strength
+#define CURVE_LUT_SIZE 256
+#define VELOCITY_TABLE_SIZE 32
+#define GLIDE_DEFAULT_VELOCITY 30 // rad/s, where the detents cut out when the profile doesn't set a glide
+#define CROSSFADE_TABLE_SIZE 32
+#define PREDICT_ACCEL_ALPHA 0.05 // Smoothing of the acceleration estimate per loop iteration, it is the derivative of an already noisy velocity
+
+#define EFFECT_SAMPLE_RATE 10000 // Hz, effects are played back against micros(), independent of the loop rate
+#define EFFECT_MAX_SAMPLES 1000 // 100ms
+
+class HapticInterface;
+
+extern PIDController default_pid; // Device wide base tuning, every profile's controller starts from it
+extern Seqlock<PidTuning> pid_tuning; // Per-unit tuning from autotune(), applied on top of default_pid when valid. Written by the FOC thread only, profiles compile on either core
+
+/**
+ * One effect of the effect table, samples are fractions (of 127) of the effect strength.
+*/
+typedef struct {
+    uint16_t length;
+    int8_t samples[EFFECT_MAX_SAMPLES];
+} EffectWaveform;
+
+/**
+ * Step response figures measured by HapticInterface::step_response(), relative to the step size.
+*/
+typedef struct {
+    float rise_us;      // 10% to 90%
+    float overshoot;    // fraction of the step past the target
+    uint8_t crossings;  // crossings of the target outside a 2% band, i.e. ringing
+    float settle_us;    // last time outside a 5% band
+    bool settled;
+} StepResponse;
+
+/**
+ * Detent texture compiled from the active profile by HapticState::load_profile().
+ * Everything the FOC loop needs that only changes when the profile changes is derived here once,
+ * so find_detent() and haptic_target() reduce to multiplies, compares and a bounded table lookup.
+ * What is left to branch on, the mode, the hysteresis type and the count direction, is folded into
+ * the loop kernel templates instead, see HapticInterface::loop_kernel().
+ *
+ * The attractor re-snap bounds are attract_angle * hysteresis_scale_lo/hi -/+ hysteresis_band,
+ * which covers both the regular (absolute) and the kxForce (proportional) hysteresis.
+ * error_threshold is the distance from the attractor below which the error is softened by SNAP_ERROR_GAIN.
+ * damping and stiffness are only used by the viscose, spring and curve kernels.
+ * curve[] is the curve mode force across one detent in Q15, curve_scale turns it into torque.
+ * velocity_gain[] scales the detent strength by the knob speed, from 0 to glide_end in VELOCITY_TABLE_SIZE steps.
+ * p_gain[] holds the P gains correct_pid() picks from, indexed by wasAtLimit << 1 | clipping.
+ * settle_damping critically damps the detent P gain for the endstop re-entry, see HapticInterface::bounds_handler().
+ * crossfade_rate turns the time since switching to this profile into crossfade table steps.
+*/
+typedef struct {
+    float inv_detent_width;
+    float hysteresis_scale_lo;
+    float hysteresis_scale_hi;
+    float hysteresis_band;
+    float d_gain;
+    float p_gain[4];
+    float settle_damping;
+    float damping;
+    float stiffness;
+    float error_threshold;
+    float curve_scale;
+    int16_t curve[CURVE_LUT_SIZE + 1];
+    float inv_velocity_step;
+    float velocity_gain[VELOCITY_TABLE_SIZE + 1];
+    float crossfade_rate;
+} DetentTexture;
 
 /**
  * Define start and end positions. These are the physical detent limits.
@@ -19,7 +96,7 @@ class HapticState
 public:
     HapticState(void);
     HapticState(DetentProfile profile);
-    HapticState(DetentProfile profile, uint16_t positon);
+    HapticState(DetentProfile profile, int32_t positon);
     ~HapticState();
 
     DetentProfile detent_profile;
@@ -27,8 +104,8 @@ public:
     DetentProfile DefaultVernierProfile;
     DetentProfile TempProfile;
 
-    uint16_t current_pos = 0;
-    uint16_t last_pos = 0; 
+    int32_t current_pos = 0;
+    int32_t last_pos = 0; 
 
     float attract_angle = 0.0; 
     float last_attract_angle = 0.0;
@@ -39,21 +116,57 @@ public:
 
     bool atLimit = false;
     bool wasAtLimit = false;
+    bool boundsSettling = false; // Re-entering bounds from an endstop, see HapticInterface::bounds_handler
+    float settle_angle = 0.0; // Endstop detent the knob settles back to after re-entering bounds
 
     //General parameters loaded from profile
-    uint16_t num_detents;
+    int32_t min_pos; // Position bounds, vernier scaled, or the full int32 range in endless mode
+    int32_t max_pos;
     float detent_width;
+    DetentTexture texture;
+    PIDController pid { 5.0, 0.0, 0.004, 10000, 0.4 }; // This profile's controller, gains set by compile_gains()
+    void (HapticInterface::*kernel[2])(void); // Loop kernel per sensor direction, indexed by sensor_direction == CCW, selected in load_profile()
+
+    void load_profile(DetentProfile, int32_t);
 
-    void load_profile(DetentProfile, uint16_t);
+private:
+    template<HapticMode MODE> void select_kernel(void);
+    void compile_texture(void);
+    void compile_curve(void);
+    void compile_glide(void);
+    void compile_gains(void);
 };
 
 class HapticInterface
 {
+    friend class HapticState;
+
 public:
-    HapticState haptic_state;   // Haptic state
+    HapticState* haptic_state;  // Haptic state, owned by the caller and swapped on profile changes
 
     BLDCMotor* motor;
-    PIDController* haptic_pid;
+    PIDController* haptic_pid; // Base tuning, used for calibration, the kernels run the haptic state's controller
+
+    // Last error and output of the active kernel, for telemetry. kernel_output is the output before the anticogging,
+    // effect and clip are added, i.e. the torque of the texture alone.
+    float haptic_error = 0.0;
+    float haptic_output = 0.0;
+    float kernel_output = 0.0;
+
+    float clip_torque = 0.0; // Torque clip playing on top of the kernel output, set by the FOC thread every iteration
+
+    // Angle prediction. The kernels run on predicted_angle, the shaft angle extrapolated by predict_lead,
+    // which the FOC thread sets to the time from the sensor latching the angle until the output is applied.
+    // prediction_error is how far an extrapolation is off the angle measured once its lead has passed,
+    // prediction_baseline how far the angle it started from is, i.e. the error without prediction.
+    // prediction_checks counts the checks, they update every few iterations when the lead spans several.
+    float predict_lead = 0.0; // s
+    float predicted_angle = 0.0;
+    float prediction_error = 0.0;
+    float prediction_baseline = 0.0;
+    uint32_t prediction_checks = 0;
+
+    AnticoggingTable anticogging = { .valid = false };
 
     // All the various constructors.
     HapticInterface(BLDCMotor* _motor);
@@ -61,15 +174,62 @@ public:
 
     void init(void);
     void haptic_loop(void);
+    void direct_loop(float torque);
+    void reanchor(void);
+    void capture_state(void);
+    void switch_state(HapticState*);
+    void start_effect(HapticEffect, uint8_t);
     void HapticEventCallback(HapticEvt);
-    void UserHapticEventCallback(HapticEvt, float, uint16_t);
+    void UserHapticEventCallback(HapticEvt, float, int32_t);
+    bool calibrate_anticogging(void);
+    bool autotune(void);
 
 private:
     void offset_detent(void);
-    void find_detent(void);
-    void detent_handler(void);
-    void bounds_handler(float);
+    template<HapticMode MODE, bool KX_FORCE, bool ALIGNED> void loop_kernel(void);
+    template<bool KX_FORCE, bool ALIGNED> void find_detent(void);
+    template<bool ALIGNED> void detent_handler(void);
+    template<bool ALIGNED> void bounds_handler(float);
     void update_position(void);
-    void haptic_target(void);
+    template<bool ALIGNED> void haptic_target(void);
+    void viscose_target(void);
+    template<bool ALIGNED> void spring_target(void);
+    template<bool ALIGNED> void curve_target(void);
     void correct_pid(void);
+    void predict_angle(void);
+    void drive(float, float);
+    void build_effects(void);
+    void build_crossfade(void);
+
+    // Effect table, built once in init(), and the effect currently playing
+    EffectWaveform effects[HAPTIC_EFFECT_COUNT];
+    const EffectWaveform* effect_playing = nullptr;
+    unsigned long effect_start = 0;
+    float effect_gain = 0.0;
+
+    // Previous profile, captured by capture_state(), its attractor fades out after a switch
+    PIDController fade_pid { 5.0, 0.0, 0.004, 10000, 0.4 };
+    float fade_angle = 0.0;
+    int32_t fade_pos = 0;
+    int32_t fade_min_pos = 0;
+    int32_t fade_max_pos = 0;
+    bool fade_endless = false;
+    bool fading = false;
+    unsigned long fade_start = 0;
+    float crossfade[CROSSFADE_TABLE_SIZE + 1]; // Smoothstep from 0 to 1, built once in init()
+
+    // Previous iteration of the angle prediction
+    unsigned long predict_ts = 0;
+    float predict_angle_prev = 0.0;
+    float predict_velocity = 0.0;
+    float predict_accel = 0.0;
+    // Extrapolation waiting for its lead to pass
+    unsigned long check_ts = 0;
+    float check_predicted = 0.0;
+    float check_sampled = 0.0;
+    bool check_pending = false;
+    void clear_overlays(void);
+    void hold(PIDController&, float, unsigned long, float*);
+    void step_response(PIDController&, float, float, StepResponse*);
+    bool step_acceptable(PIDController&, float, StepResponse*);
 };
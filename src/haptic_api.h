@@ -35,17 +35,54 @@ typedef enum : uint8_t {
  * In vernier mode, the number of detents is multiplied by the vernier multiplier, with "major" clicks where the regular detents would overlay.
  * In viscose mode, the knob is smooth but heavy and resists motion.
  * In spring mode, the knob returns to a defined point.
+ * In curve mode, the force within each detent follows a user defined curve, see DetentProfile.
 */
 typedef enum : uint8_t {
     REGULAR = 0,    //Only coarse detents used
     VERNIER = 1,    // Coarse with fine between
     VISCOSE = 2,    // Resistance while turning
-    SPRING = 3     // Snap back to center point
+    SPRING = 3,    // Snap back to center point
+    CURVE = 4      // Force curve across each detent
 } HapticMode;
 
+/**
+ * Short torque waveforms played on top of the haptic texture, see HapticInterface::start_effect().
+*/
+typedef enum : uint8_t {
+    EFFECT_NONE = 0,
+    EFFECT_CLICK = 1,       // Single sharp impulse
+    EFFECT_BUZZ = 2,        // 60ms vibration
+    EFFECT_DOUBLE_TAP = 3,  // Two clicks 40ms apart
+    EFFECT_RAMP = 4,        // 100ms vibration rising in strength
+    EFFECT_BUMP = 5         // Soft 20ms push and pull
+} HapticEffect;
+
+#define HAPTIC_EFFECT_COUNT 6
+
+#define CURVE_MAX_POINTS 16
+
 /**
  * Defines the actual behavior of the detent profile.
  * Setting kxForce changes the feel of the detents so that larger values require larger force.
+ * In viscose and spring mode detent_strength scales the damping and the spring stiffness,
+ * spring_center is the position the knob returns to in spring mode.
+ * With endless set there are no endstops, start_pos and end_pos are ignored and the position
+ * keeps counting in both directions, use the relative deltas of the events to follow it.
+ * limit_effect is played when the knob runs into an endstop, EFFECT_NONE for the plain endstop.
+ *
+ * In curve mode curve holds curve_points control points {x, force}, sorted by x. x runs from -127 to 127
+ * across one detent (-half to +half a detent width around the detent, in the direction the position counts up),
+ * force from -127 to 127 is the torque in that direction as a fraction of the strength. A spline through the points is compiled
+ * into a lookup table on load, so uneven sub-detents, walls, notches and dead zones all cost the same.
+ *
+ * Above glide_start (rad/s) the detent strength fades out smoothly, reaching glide_floor (fraction of the
+ * full strength) at glide_end, so fast spins glide and slow adjustments click. With glide_end 0 the detents
+ * cut out at 30 rad/s like they always did.
+ *
+ * pid_p and pid_d override the detent P and D gains for this profile, 0 keeps the derived defaults.
+ *
+ * crossfade (ms) is how long switching to this profile takes, the previous profile's attractor fades out while
+ * this one fades in. 0 switches straight away. Either way the knob keeps its angle and the position is remapped.
 */
 typedef struct {
     HapticMode mode;
@@ -56,12 +93,62 @@ typedef struct {
     bool kxForce;
     float output_ramp;
     float detent_strength;
+    uint16_t spring_center;
+    bool endless;
+    HapticEffect limit_effect;
+    uint8_t curve_points;
+    int8_t curve[CURVE_MAX_POINTS][2];
+    float glide_start;
+    float glide_end;
+    float glide_floor;
+    float pid_p;
+    float pid_d;
+    uint16_t crossfade;
 } DetentProfile;
 
+#define ANTICOGGING_TABLE_SIZE 512 // power of two, fine enough for the 84 cogging periods per turn of a 12N14P motor
+
+/**
+ * Per-unit cogging compensation, indexed by the raw mechanical sensor angle over one turn.
+ * Torques are stored as int8 multiples of scale (motor target units), in the physical rotation direction.
+*/
+typedef struct {
+    bool valid;
+    float scale;
+    int8_t torque[ANTICOGGING_TABLE_SIZE];
+} AnticoggingTable;
+
+/**
+ * Per-unit PID tuning found by HapticInterface::autotune(), replaces the default detent P, D and output ramp
+ * for every profile that doesn't set its own.
+*/
+typedef struct {
+    bool valid;
+    float p;
+    float d;
+    float output_ramp;
+} PidTuning;
+
+/**
+ * Compact record of a HapticEvt, handed from the FOC thread to the listeners on the other core.
+*/
+typedef struct {
+    HapticEvt type;
+    int32_t pos;
+    uint32_t timestamp; // us
+} DetentEvt;
+
 /**
  * This is used for regular reporting of the knob mechanical state
  * if you are using the library as part of a larger system.
+ * The shaft angle is split into the angle within the current turn [0, 2PI) and the number of full turns.
 */
 typedef struct {
-    uint16_t cur_pos;
+    int32_t cur_pos;
+    int32_t delta;      // detents since the previous AngleEvt
+    float angle;        // rad
+    int32_t turns;
+    float velocity;     // rad/s
+    float torque;       // motor target, estimated current (A)
+    uint32_t timestamp; // us
 } AngleEvt;
@@ -0,0 +1,264 @@
+#include "haptic_clip.h"
+#include "SPIFFS.h"
+#include "utils.h"
+
+
+String HapticClip::path(const String& name) {
+    return String(CLIPS_DIRECTORY) + "/" + name + ".clip";
+};
+
+
+ClipState HapticClip::get_state() {
+    return (ClipState)state.load(std::memory_order_acquire);
+};
+
+
+const String& HapticClip::get_name() {
+    return clip_name;
+};
+
+
+/**
+ * Opens a clip and starts playing it at strength (255 = full scale). A clip already playing or recording is stopped.
+ */
+bool HapticClip::play(const String& name, uint8_t strength) {
+    stop();
+    file = SPIFFS.open(path(name), "r");
+    if (!file)
+        return false;
+    if (file.read((uint8_t*)&header, sizeof(header)) != sizeof(header) || header.magic != CLIP_MAGIC
+        || header.rate == 0 || header.rate > CLIP_MAX_RATE) {
+        file.close();
+        return false;
+    }
+
+    clip_name = name;
+    remaining = header.length;
+    load_index = 0;
+    fill[0].store(0, std::memory_order_relaxed);
+    fill[1].store(0, std::memory_order_relaxed);
+    loaded.store(false, std::memory_order_relaxed);
+    load_block();
+    load_block();
+
+    gain = strength / (255.0f * 32768.0f);
+    period_us = 1000000 / header.rate;
+    started = false;
+    play_index = 0;
+    block_start = 0;
+    state.store(CLIP_PLAYING, std::memory_order_release);
+    return true;
+};
+
+
+/**
+ * Starts recording the knob torque into a new clip, replacing one of the same name. The rate is capped at CLIP_MAX_RATE.
+ */
+bool HapticClip::record(const String& name, uint16_t rate) {
+    stop();
+    if (rate == 0)
+        return false;
+    rate = min(rate, (uint16_t)CLIP_MAX_RATE);
+    if (!SPIFFS.exists(CLIPS_DIRECTORY))
+        SPIFFS.mkdir(CLIPS_DIRECTORY);
+    file = SPIFFS.open(path(name), "w");
+    if (!file)
+        return false;
+
+    header = HapticClipHeader{ .magic = CLIP_MAGIC, .rate = rate, .reserved = 0, .length = 0 };
+    file.write((uint8_t*)&header, sizeof(header));
+    clip_name = name;
+    recording = true;
+
+    int16_t discard;
+    while (recorded.pop(discard));
+    period_us = 1000000 / rate;
+    started = false;
+    state.store(CLIP_RECORDING, std::memory_order_release);
+    return true;
+};
+
+
+/**
+ * Stops playback or recording and closes the clip, a recording is finalized.
+ */
+void HapticClip::stop() {
+    if (state.load(std::memory_order_acquire) != CLIP_IDLE) {
+        stop_request.store(true, std::memory_order_release);
+        for (int i=0; i<CLIP_STOP_WAIT_MS && state.load(std::memory_order_acquire) != CLIP_IDLE; i++)
+            vTaskDelay(1);
+        // the FOC loop isn't running, e.g. during a calibration
+        state.store(CLIP_IDLE, std::memory_order_release);
+    }
+    stop_request.store(false, std::memory_order_relaxed);
+    close();
+};
+
+
+/**
+ * Call regularly from the comms thread: refills the blocks the FOC thread handed back, writes out recorded samples,
+ * and closes the clip once it finished.
+ */
+void HapticClip::service() {
+    if (!file)
+        return;
+
+    uint8_t current = state.load(std::memory_order_acquire);
+    if (recording) {
+        drain_recording();
+        if (header.length >= (uint64_t)header.rate * CLIP_RECORD_MAX_MS / 1000)
+            stop();
+        else if (current == CLIP_IDLE)
+            close();
+    }
+    else if (current == CLIP_PLAYING) {
+        while (load_block());
+    }
+    else
+        close();
+};
+
+
+/**
+ * Loads the next samples into the next block if the FOC thread is done with it.
+ */
+bool HapticClip::load_block() {
+    if (remaining == 0 || fill[load_index].load(std::memory_order_acquire) != 0)
+        return false;
+
+    uint16_t count = min(remaining, (uint32_t)CLIP_BLOCK_SAMPLES);
+    count = file.read((uint8_t*)blocks[load_index], count * sizeof(int16_t)) / sizeof(int16_t);
+    remaining = count > 0 ? remaining - count : 0;
+    if (count > 0) {
+        fill[load_index].store(count, std::memory_order_release);
+        load_index ^= 1;
+    }
+    // only after the last block is visible, the FOC thread ends the playback on loaded and two empty blocks
+    if (remaining == 0)
+        loaded.store(true, std::memory_order_release);
+    return count > 0;
+};
+
+
+void HapticClip::drain_recording() {
+    int16_t chunk[64];
+    uint16_t count = 0;
+    while (recorded.pop(chunk[count])) {
+        if (++count == 64) {
+            file.write((uint8_t*)chunk, sizeof(chunk));
+            header.length += count;
+            count = 0;
+        }
+    }
+    if (count > 0) {
+        file.write((uint8_t*)chunk, count * sizeof(int16_t));
+        header.length += count;
+    }
+};
+
+
+void HapticClip::close() {
+    if (!file)
+        return;
+    if (recording) {
+        drain_recording();
+        file.seek(0);
+        file.write((uint8_t*)&header, sizeof(header));
+        recording = false;
+    }
+    file.close();
+};
+
+
+/**
+ * Writes designed samples (-1..1) into a clip, or appends them, so long clips can be sent in parts.
+ */
+bool HapticClip::write(const String& name, uint16_t rate, JsonArray samples, bool append) {
+    if (name == clip_name)
+        stop();
+
+    File out;
+    HapticClipHeader h = { .magic = CLIP_MAGIC, .rate = rate, .reserved = 0, .length = 0 };
+    if (append && SPIFFS.exists(path(name))) {
+        out = SPIFFS.open(path(name), "r+");
+        if (!out || out.read((uint8_t*)&h, sizeof(h)) != sizeof(h) || h.magic != CLIP_MAGIC)
+            return false;
+        out.seek(0, SeekEnd);
+    }
+    else {
+        // the samples are designed for their rate, so a rate playback can't keep up with is refused rather than capped
+        if (rate == 0 || rate > CLIP_MAX_RATE)
+            return false;
+        if (!SPIFFS.exists(CLIPS_DIRECTORY))
+            SPIFFS.mkdir(CLIPS_DIRECTORY);
+        out = SPIFFS.open(path(name), "w");
+        if (!out)
+            return false;
+        out.write((uint8_t*)&h, sizeof(h));
+    }
+
+    for (JsonVariant v : samples) {
+        int16_t sample = (int16_t)roundf(CLAMP(v.as<float>(), -1.0f, 1.0f) * 32767.0f);
+        out.write((uint8_t*)&sample, sizeof(sample));
+        h.length++;
+    }
+    out.seek(0);
+    out.write((uint8_t*)&h, sizeof(h));
+    out.close();
+    return true;
+};
+
+
+/**
+ * The playing clip's sample for now, 0 when nothing plays. Ends the playback at the end of the clip.
+ */
+float HapticClip::play_sample(unsigned long now) {
+    if (state.load(std::memory_order_acquire) != CLIP_PLAYING)
+        return 0.0f;
+    if (stop_request.load(std::memory_order_relaxed)) {
+        state.store(CLIP_IDLE, std::memory_order_release);
+        return 0.0f;
+    }
+    if (!started) {
+        started = true;
+        start_ts = now;
+    }
+
+    uint32_t index = (now - start_ts) / period_us;
+    uint16_t count = fill[play_index].load(std::memory_order_acquire);
+    while (index >= block_start + count) {
+        if (count == 0) {
+            // the comms thread hasn't caught up, or that was the last block
+            if (loaded.load(std::memory_order_acquire) && fill[play_index ^ 1].load(std::memory_order_acquire) == 0)
+                state.store(CLIP_IDLE, std::memory_order_release);
+            return 0.0f;
+        }
+        block_start += count;
+        fill[play_index].store(0, std::memory_order_release);
+        play_index ^= 1;
+        count = fill[play_index].load(std::memory_order_acquire);
+    }
+    return blocks[play_index][index - block_start] * gain;
+};
+
+
+/**
+ * Takes a sample of the knob torque when one is due while recording.
+ */
+void HapticClip::record_sample(float fraction, unsigned long now) {
+    if (state.load(std::memory_order_acquire) != CLIP_RECORDING)
+        return;
+    if (stop_request.load(std::memory_order_relaxed)) {
+        state.store(CLIP_IDLE, std::memory_order_release);
+        return;
+    }
+    if (!started) {
+        started = true;
+        start_ts = now;
+    }
+    if ((long)(now - start_ts) < 0)
+        return;
+
+    recorded.push((int16_t)roundf(CLAMP(fraction, -1.0f, 1.0f) * 32767.0f));
+    start_ts += period_us;
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include <ArduinoJSON.h>
+#include "FS.h"
+#include "spsc_ring.h"
+
+#define CLIPS_DIRECTORY "/clips"
+#define CLIP_MAGIC 0x50494C43 // "CLIP"
+#define CLIP_DEFAULT_RATE 1000 // samples per second
+#define CLIP_MAX_RATE 2000 // a block still lasts 128ms and the record ring 256ms, against the comms thread refilling every ~10ms
+#define CLIP_BLOCK_SAMPLES 256 // per half of the playback double buffer, 256ms at the default rate
+#define CLIP_RECORD_RING 512 // recorded samples in flight to the comms thread, 0.5s at the default rate
+#define CLIP_RECORD_MAX_MS 60000 // recordings stop by themselves after this long
+#define CLIP_STOP_WAIT_MS 10 // how long stop() waits for the FOC thread to let go of the clip
+
+/**
+ * Clip file, stored as CLIPS_DIRECTORY/<name>.clip: this header followed by length int16 samples (little endian).
+ * Samples are Q15 fractions of the haptic output limit, at rate samples per second.
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t rate;
+    uint16_t reserved;
+    uint32_t length;
+} HapticClipHeader;
+
+typedef enum : uint8_t {
+    CLIP_IDLE = 0,
+    CLIP_PLAYING = 1,
+    CLIP_RECORDING = 2
+} ClipState;
+
+
+/**
+ * Plays torque clips from SPIFFS into the FOC loop, and records the knob torque into new ones.
+ *
+ * The file side runs on the comms thread: play() and record() open the clip, service() keeps the data moving
+ * and closes the file at the end. The FOC thread calls play_sample() and record_sample() once per loop iteration.
+ *
+ * Playback streams through a double buffer, so clips of any length play from two blocks of RAM. A block belongs to
+ * the comms thread while its fill count is 0, it loads the next samples and publishes the count, the FOC thread plays
+ * the block and hands it back by clearing the count. Playback is paced by micros(), if a block is late the clip
+ * goes quiet for the gap rather than slowing down. Recorded samples travel the other way through an SpscRing.
+ */
+class HapticClip {
+    public:
+        // comms thread
+        bool play(const String& name, uint8_t strength);
+        bool record(const String& name, uint16_t rate);
+        void stop();
+        void service();
+        bool write(const String& name, uint16_t rate, JsonArray samples, bool append);
+        ClipState get_state();
+        const String& get_name();
+
+        // FOC thread, fraction of the haptic output limit
+        float play_sample(unsigned long now);
+        void record_sample(float fraction, unsigned long now);
+
+    protected:
+        String path(const String& name);
+        bool load_block();
+        void drain_recording();
+        void close();
+
+        // comms thread side
+        File file;
+        String clip_name = "";
+        HapticClipHeader header;
+        uint32_t remaining = 0; // samples left in the file
+        uint8_t load_index = 0; // block the next samples go into
+        bool recording = false;
+
+        // shared
+        std::atomic<uint8_t> state { CLIP_IDLE };
+        std::atomic<bool> stop_request { false };
+        std::atomic<bool> loaded { false }; // the last block is in the buffer
+        std::atomic<uint16_t> fill[2];
+        int16_t blocks[2][CLIP_BLOCK_SAMPLES];
+        SpscRing<int16_t, CLIP_RECORD_RING> recorded;
+        uint32_t period_us = 0;
+        float gain = 0.0f;
+
+        // FOC thread side, reset by the comms thread before the state is published
+        bool started = false;
+        unsigned long start_ts = 0;
+        uint8_t play_index = 0;
+        uint32_t block_start = 0; // clip sample index of the first sample in the playing block
+};
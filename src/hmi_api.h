@@ -36,6 +36,19 @@ typedef struct {
 
 
 
+typedef struct {
+    HapticEffect effect;
+    uint8_t strength;
+} nanoEffectConfig;
+
+
+
+typedef struct {
+    uint8_t strength;
+} nanoClipConfig;
+
+
+
 
 
 
@@ -48,7 +61,9 @@ typedef enum {
     KA_GAMEPAD = 4,
     KA_PROFILE_CHANGE = 5,
     KA_PROFILE_NEXT = 6,
-    KA_PROFILE_PREV = 7
+    KA_PROFILE_PREV = 7,
+    KA_HAPTIC_EFFECT = 8,
+    KA_HAPTIC_CLIP = 9
 } keyActionType;
 
 
@@ -59,8 +74,11 @@ typedef struct {
         nanoKeyboardConfig hid;
         nanoMouseConfig mouse;
         nanoGamepadConfig pad;
+        nanoEffectConfig effect;
+        nanoClipConfig clip;
     };
     String profile="";
+    String clip_name="";
 } keyAction;
 
 
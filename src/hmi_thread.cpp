@@ -78,6 +78,8 @@ void HmiThread::init(ledConfig& initial_led_config, hmiConfig& initial_hmi_confi
     midi2.setHandleSystemExclusive(midi_sysex_handler);  
     midi2.begin();
     audioPlayer.audio_init();
+    add_detent_listener(play_detent_audio);
+    add_detent_listener(led_detent_listener);
 };
 
 
@@ -106,10 +108,12 @@ void HmiThread::handleConfig() {
             FastLED.setBrightness(newBrightness);
         }
         updateKeyLeds();
+        pointer_dirty = true;
     }
     hmiConfig newHmiConfig;
     if (xQueueReceive(_q_hmi_config_in, &newHmiConfig, (TickType_t)0)) {
         hmi_config = newHmiConfig;
+        relative_valid = false;
     }
 };
 
@@ -135,6 +139,30 @@ void HmiThread::handleSettings() {
 };
 
 
+bool HmiThread::add_detent_listener(DetentEventListener listener) {
+    if (num_detent_listeners >= MAX_DETENT_LISTENERS)
+        return false;
+    detent_listeners[num_detent_listeners++] = listener;
+    return true;
+};
+
+
+// Detent event listener, the LED pointer is only redrawn when the position moved
+void HmiThread::led_detent_listener(const DetentEvt& evt) {
+    hmi_thread.pointer_dirty = true;
+};
+
+
+// drains the detent events pushed by the FOC thread and hands each one to every listener
+void HmiThread::handleDetentEvents() {
+    DetentEvt evt;
+    while (foc_thread.get_detent_event(&evt)) {
+        for (int i = 0; i < num_detent_listeners; i++)
+            detent_listeners[i](evt);
+    }
+};
+
+
 bool HmiThread::get_key_event(KeyEvt* keyEvt){
     return xQueueReceive(_q_keyevt_out, keyEvt, (TickType_t)0);
 };
@@ -184,6 +212,7 @@ void HmiThread::run() {
         handleSettings();
         handleConfig();
         handleMidi();
+        handleDetentEvents();
         for (int i = 0; i < 4; i++)
             buttons[i]->check();
         updateValue();
@@ -296,6 +325,16 @@ void HmiThread::handleKeyAction(keyAction& action, uint8_t eventType) {
             if (eventType==AceButton::kEventPressed)
                 com_thread.put_string_message(msg);
         break;
+        case keyActionType::KA_HAPTIC_EFFECT:
+            if (eventType==AceButton::kEventPressed)
+                foc_thread.play_effect(action.effect.effect, action.effect.strength);
+        break;
+        case keyActionType::KA_HAPTIC_CLIP:
+            if (action.clip_name!="" && eventType==AceButton::kEventPressed) {
+                StringMessage msg(new String(action.clip_name), STRING_MESSAGE_CLIP, action.clip.strength);
+                com_thread.put_string_message(msg);
+            }
+        break;
     }
 };
 
@@ -303,10 +342,23 @@ void HmiThread::handleKeyAction(keyAction& action, uint8_t eventType) {
 
 void HmiThread::updateValue() {
     if (hmi_config.knob.num>0) {
-        float angle = foc_thread.get_motor_angle();
+        HapticSnapshot snap = foc_thread.get_snapshot();
+        float angle = snap.angle;
+        // Relative steps are the exact distance from the position they were last sent up to, so none get lost
+        // to a full detent ring, and steps turned while no value maps the current keys wait until one does.
+        if (!snap.endless || !relative_valid) {
+            relative_pos = snap.current_pos;
+            relative_valid = snap.endless;
+        }
+        int32_t steps = snap.current_pos - relative_pos;
         for (int i=0;i<hmi_config.knob.num;i++) {
             knobValue& v = hmi_config.knob.values[i];
-            if (v.key_state==keyState) {
+            if (v.key_state==keyState && snap.endless) {
+                if (steps!=0)
+                    sendRelative(v, steps);
+                relative_pos = snap.current_pos;
+            }
+            else if (v.key_state==keyState) {
                 float value = 0;
                 if (v.angle_min<v.angle_max) {
                     _constrain(angle, v.angle_min, v.angle_max);
@@ -324,7 +376,7 @@ void HmiThread::updateValue() {
                     value = round(value / v.step) * v.step;
                 }
                 currentValue = value;
-                currentValue = foc_thread.pass_cur_pos(); // TODO fix and remove this in future
+                currentValue = snap.current_pos; // TODO fix and remove this in future
                 if (currentValue!=lastValue) {
                     if (v.type==knobValueType::KV_MIDI) {
                         uint8_t midi_value = (uint8_t)(currentValue);
@@ -343,6 +395,32 @@ void HmiThread::updateValue() {
 
 
 
+/**
+ * Endless mode output, the detents turned since the last update are sent as relative steps:
+ * MIDI as relative CC (binary offset, 64 = no change), mouse as wheel (axis 0) or pan (axis 1) ticks.
+ * Large jumps are split into several messages so no detents are lost.
+ */
+void HmiThread::sendRelative(knobValue& v, int32_t steps) {
+    while (steps!=0) {
+        int8_t chunk = _constrain(steps, -63, 63);
+        if (v.type==knobValueType::KV_MIDI) {
+            if (midiUsbSettings.nano)
+                midiu.sendControlChange(v.midi.cc, 64 + chunk, v.midi.channel);
+            if (midi2Settings.nano)
+                midi2.sendControlChange(v.midi.cc, 64 + chunk, v.midi.channel);
+        }
+        else if (v.type==knobValueType::KV_MOUSE && usb_hid.ready()) {
+            if (v.mouse.axis==0)
+                usb_hid.mouseScroll(RID_MOUSE, chunk, 0);
+            else
+                usb_hid.mouseScroll(RID_MOUSE, 0, chunk);
+        }
+        steps -= chunk;
+    }
+};
+
+
+
 void HmiThread::handleHid() {
 
     bool keys_changed = (num_key_codes!=last_num_key_codes);
@@ -393,6 +471,8 @@ void HmiThread::handleMidi() {
         if (midiUsbSettings.route && midi2Settings.out) {
             midi2.send(t, d1, d2, c);        
         }
+        if (midiUsbSettings.in)
+            handleMidiEffect(t, d1, d2);
     }
     if (midi2.read()) {
         midi::MidiType t = midi2.getType();
@@ -402,11 +482,23 @@ void HmiThread::handleMidi() {
         if (midi2Settings.route && midiUsbSettings.out) {
             midiu.send(t, d1, d2, c);        
         }
+        if (midi2Settings.in)
+            handleMidiEffect(t, d1, d2);
     }
 };
 
 
 
+// Note on from MIDI_EFFECT_NOTE up plays the haptic effects in order, the velocity sets the strength
+void HmiThread::handleMidiEffect(uint8_t type, uint8_t note, uint8_t velocity) {
+    if (type!=midi::NoteOn || velocity==0)
+        return;
+    if (note>=MIDI_EFFECT_NOTE && note<MIDI_EFFECT_NOTE+HAPTIC_EFFECT_COUNT-1)
+        foc_thread.play_effect((HapticEffect)(note-MIDI_EFFECT_NOTE+1), velocity*2+1);
+};
+
+
+
 void HmiThread::handleSysex(byte* array, unsigned size){
     if (array[0]==SYSEX_BINARIS_ID && array[1]==SYSEX_NANO_ID && array[2]==hmi_thread.midi_sysex_id) {
         Serial.println("Received a sysex message");
@@ -439,28 +531,43 @@ void HmiThread::updateKeyLeds() {
 // Define a variable to store the last time cur_pos was updated
 
 void HmiThread::updateLeds() {
-    // TODO: optimise this
-    uint16_t cur_pos = foc_thread.pass_cur_pos();
-    uint16_t start_pos = foc_thread.pass_start_pos();
-    uint16_t end_pos = foc_thread.pass_end_pos();
-    uint8_t device_orientation = DeviceSettings::getInstance().deviceOrientation;
-    uint8_t led_orientation = map(device_orientation, 0, 3, 0, 135);
-    uint16_t point = map(cur_pos, end_pos, start_pos, 0, NANO_LED_A_NUM - 1);
-    uint16_t start = map(start_pos, end_pos, start_pos, 0, NANO_LED_A_NUM - 1);
-    uint16_t end = map(end_pos, end_pos, start_pos, 0, NANO_LED_A_NUM - 1);
-
-
      if (com_thread.global_sleep_flag) {
         hmi_thread.IdleLeds(25, CRGB::Red, CRGB::Green, CRGB::Blue);
         FastLED.setBrightness(25);
+        pointer_dirty = true; // the idle animation drew over the pointer
     } else {
-        halvesPointer(point, start, end, led_orientation, (led_config.pointer_col), CRGB(led_config.primary_col), CRGB(led_config.secondary_col));
+        // Detent events mark the pointer dirty, profile switches move no detent and are caught by the slow refresh
+        if (pointer_dirty || millis() - pointer_refreshed >= LED_POINTER_REFRESH_MS)
+            updatePointer();
         updateKeyLeds();
         FastLED.setBrightness(led_config.led_brightness);
     }
 };
 
-    
+
+
+void HmiThread::updatePointer() {
+    pointer_dirty = false;
+    pointer_refreshed = millis();
+    HapticSnapshot snap = foc_thread.get_snapshot();
+    int32_t cur_pos = snap.current_pos;
+    uint16_t start_pos = snap.start_pos;
+    uint16_t end_pos = snap.end_pos;
+    uint8_t device_orientation = DeviceSettings::getInstance().deviceOrientation;
+    uint8_t led_orientation = map(device_orientation, 0, 3, 0, 135);
+    // endless has no range to map, the pointer just goes round the ring one LED per detent
+    if (snap.endless) {
+        cur_pos = ((cur_pos % NANO_LED_A_NUM) + NANO_LED_A_NUM) % NANO_LED_A_NUM;
+        start_pos = NANO_LED_A_NUM - 1;
+        end_pos = 0;
+    }
+    uint16_t point = map(cur_pos, end_pos, start_pos, 0, NANO_LED_A_NUM - 1);
+    uint16_t start = map(start_pos, end_pos, start_pos, 0, NANO_LED_A_NUM - 1);
+    uint16_t end = map(end_pos, end_pos, start_pos, 0, NANO_LED_A_NUM - 1);
+
+    halvesPointer(point, start, end, led_orientation, (led_config.pointer_col), CRGB(led_config.primary_col), CRGB(led_config.secondary_col));
+};
+
 
 
 
@@ -8,6 +8,13 @@
 #include "./led_api.h"
 #include "./hmi_api.h"
 #include "./DeviceSettings.h"
+#include "./haptic_api.h"
+
+#define MAX_DETENT_LISTENERS 4
+#define LED_POINTER_REFRESH_MS 200 // the pointer is redrawn on detent events, and this often for profile switches
+#define MIDI_EFFECT_NOTE 36 // note on C1 plays EFFECT_CLICK, the following notes the other haptic effects
+
+typedef void (*DetentEventListener)(const DetentEvt& evt);
 
 using namespace ace_button;
 
@@ -48,6 +55,9 @@ class HmiThread : public Thread<HmiThread> {
         void put_hmi_config(hmiConfig& new_config);
         void put_settings(HmiDeviceSettings& new_settings);
 
+        // detent events from the FOC thread, register listeners before the thread is started
+        bool add_detent_listener(DetentEventListener listener);
+
         // Light Effects
         void halvesPointer(int indicator, int startpos, int endpos, int orientation, const struct CRGB& pointerCol, const struct CRGB& preCol, const struct CRGB& postCol);
         void IdleLeds(int fps, const struct CRGB& idleColStart, const struct CRGB& idleColMid, const struct CRGB& idleColEnd);
@@ -65,6 +75,10 @@ class HmiThread : public Thread<HmiThread> {
         // internal queue handler
         void handleConfig();
         void handleSettings();
+        void handleDetentEvents();
+
+        DetentEventListener detent_listeners[MAX_DETENT_LISTENERS];
+        uint8_t num_detent_listeners = 0;
 
 
         // LEDs
@@ -75,8 +89,12 @@ class HmiThread : public Thread<HmiThread> {
         unsigned long lastCheck = 0;
         uint16_t last_pos = -1;
         bool isIdle = false;
+        bool pointer_dirty = true; // set by detent events, see led_detent_listener()
+        unsigned long pointer_refreshed = 0;
+        static void led_detent_listener(const DetentEvt& evt);
         void updateKeyLeds();
         void updateLeds();
+        void updatePointer();
 
         // buttons
         hmiConfig hmi_config;
@@ -98,10 +116,14 @@ class HmiThread : public Thread<HmiThread> {
         // knob
         float lastValue;
         float currentValue;
+        int32_t relative_pos = 0; // endless position the last relative steps were sent up to
+        bool relative_valid = false;
         void updateValue();
+        void sendRelative(knobValue& v, int32_t steps);
 
         // midi config
         void handleMidi();
+        void handleMidiEffect(uint8_t type, uint8_t note, uint8_t velocity);
         midiSettings midiUsbSettings;
         midiSettings midi2Settings;
         uint8_t midi_sysex_id = 0x00;
@@ -35,6 +35,16 @@ void LcdThread::put_lcd_command(LcdCommand& cmd) {
 };
 
 
+void LcdThread::detent_listener(const DetentEvt& evt) {
+    lcd_thread.position_changed.store(true, std::memory_order_release);
+};
+
+
+bool LcdThread::take_position_changed() {
+    return position_changed.exchange(false, std::memory_order_acq_rel);
+};
+
+
 void LcdThread::handleLcdCommand() {
     LcdCommand cmd;
     if (xQueueReceive(_q_lcd_in, &cmd, (TickType_t)0)) {
@@ -170,27 +180,38 @@ if (lv_scr_act()==ui_profSelectScreen) // Profile Selection Screen
 
 
 static void counter_handler(lv_timer_t * postimer) {
-    static uint16_t last_pos = -1; // Default Last Position
+    static int32_t last_pos = -1; // Default Last Position
     static bool overlay_toggle = false; // Default Overlay Toggle
-    uint16_t pos = foc_thread.pass_cur_pos(); // Get Current Position from FOC Thread
-    uint16_t end_pos = foc_thread.pass_end_pos(); // Get End Position from FOC Thread
+    static unsigned long last_refresh = 0;
+    // Detent events flag a new position, profile switches move no detent and are caught by the slow refresh
+    unsigned long now = millis();
+    bool refresh = lcd_thread.take_position_changed() || now - last_refresh >= LCD_POSITION_REFRESH_MS;
+    static HapticSnapshot snap = {};
+    if (refresh) {
+        snap = foc_thread.get_snapshot(); // Get consistent Haptic State from FOC Thread
+        last_refresh = now;
+    }
+    int32_t pos = snap.current_pos; // Current Position
+    uint16_t end_pos = snap.end_pos; // End Position
+    // Endless positions go negative and past any range, the arc shows them wrapped to 0..end_pos
+    int32_t arc_pos = snap.endless && end_pos > 0 ? ((pos % (end_pos + 1)) + end_pos + 1) % (end_pos + 1) : pos;
     uint16_t last_end_pos;
     
     if (pos != last_pos) {
        
        if (lv_scr_act()==ui_valueScreen){
-           lv_label_set_text_fmt(ui_posind, "%d", pos);
-           lv_label_set_text_fmt(ui_posindSha, "%d", pos);
+           lv_label_set_text_fmt(ui_posind, "%ld", (long)pos);
+           lv_label_set_text_fmt(ui_posindSha, "%ld", (long)pos);
            if (end_pos != last_end_pos) {
                lv_arc_set_range(ui_Arc1, 0, end_pos);
                last_end_pos = end_pos;
                // Don't update arc range if end_pos is same as last_end_pos
            }
-           lv_arc_set_value(ui_Arc1, pos);
+           lv_arc_set_value(ui_Arc1, arc_pos);
            last_pos = pos; // Update Last Position
        }
        if (lv_scr_act()==ui_profSelectScreen){
-           lv_label_set_text_fmt(ui_pCount, "%d", pos); // Set Position Indicator
+           lv_label_set_text_fmt(ui_pCount, "%ld", (long)pos); // Set Position Indicator
            if(last_pos != pos){
            lv_roller_set_selected(ui_profList, pos, LV_ANIM_ON); // Set Roller to Current Position - Animate ON
            last_pos = pos; // Update Last Position
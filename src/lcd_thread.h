@@ -4,9 +4,12 @@
 #include "foc_thread.h"
 #include "com_thread.h"
 #include <lvgl.h>
+#include <atomic>
 #include "thread_crtp.h"
 #include "ui.h"
 
+#define LCD_POSITION_REFRESH_MS 200 // the knob position is redrawn on detent events, and this often for profile switches
+
 
 
 typedef enum {
@@ -38,12 +41,17 @@ class LcdThread : public Thread<LcdThread> {
         void put_lcd_command(LcdCommand& cmd);
         void handleLcdCommand();
         LcdCommand last_command;
+
+        // detent event listener, called from the HMI thread, see HmiThread::add_detent_listener()
+        static void detent_listener(const DetentEvt& evt);
+        bool take_position_changed();
         
     protected:
         void run();
         
     private:
         QueueHandle_t _q_lcd_in;
+        std::atomic<bool> position_changed { true };
 };
 
 extern LcdThread lcd_thread;
@@ -52,6 +52,15 @@ void setup() {
   // load motor calibration from Preferences
   MotorCalibration cal = settings.loadCalibration();
   foc_thread.setCalibration(cal);
+  AnticoggingTable anticogging;
+  if (settings.loadCalibration(anticogging))
+    foc_thread.setCalibration(anticogging);
+  EncoderCalibration encoder_cal;
+  if (settings.loadCalibration(encoder_cal))
+    foc_thread.setCalibration(encoder_cal);
+  PidTuning tuning_cal;
+  if (settings.loadCalibration(tuning_cal))
+    foc_thread.setCalibration(tuning_cal);
   
   // load current profile from Preferences
   String current_profile = settings.loadCurrentProfile();
@@ -59,6 +68,7 @@ void setup() {
 
   // init threads
   hmi_thread.init(profileManager.getCurrentProfile()->led_config, profileManager.getCurrentProfile()->hmi_config);
+  hmi_thread.add_detent_listener(LcdThread::detent_listener);
   if (profileManager.getCurrentProfile()->hmi_config.knob.num > 0)
     foc_thread.init(profileManager.getCurrentProfile()->hmi_config.knob.values[0].haptic);
 
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+/*
+ Single-writer sequence lock, used to share small structs between cores without blocking.
+ The writer never waits. Readers copy the data and retry if the writer was active meanwhile,
+ so they always get a consistent (untorn) value.
+ Source: https://www.hpl.hp.com/techreports/2012/HPL-2012-68.pdf
+*/
+
+template <typename T>
+class Seqlock {
+    public:
+        Seqlock() : sequence { 0 } {}
+
+        // call only from the single writer thread
+        void write(const T& value) {
+            uint32_t seq = sequence.load(std::memory_order_relaxed);
+            sequence.store(seq + 1, std::memory_order_relaxed); // odd: write in progress
+            std::atomic_thread_fence(std::memory_order_release);
+            data = value;
+            sequence.store(seq + 2, std::memory_order_release);
+        }
+
+        // call from any thread
+        T read() const {
+            uint32_t version;
+            return read(version);
+        }
+
+        // same, also returns the number of the write the value came from, to detect updates without a separate version()
+        T read(uint32_t& version) const {
+            T value;
+            uint32_t before, after;
+            do {
+                before = sequence.load(std::memory_order_acquire);
+                value = data;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                after = sequence.load(std::memory_order_relaxed);
+            } while ((before & 1) || before != after);
+            version = before >> 1;
+            return value;
+        }
+
+        // number of completed writes, e.g. to detect updates
+        uint32_t version() const {
+            return sequence.load(std::memory_order_acquire) >> 1;
+        }
+
+    private:
+        std::atomic<uint32_t> sequence;
+        T data;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+/*
+ Lock-free single producer, single consumer ring buffer of N entries (N a power of two).
+ The producer never waits: push() fails when the ring is full and the entry is dropped.
+ Head and tail are free running counters, only the producer writes head and only the consumer writes tail.
+*/
+
+template <class T, uint16_t N>
+class SpscRing {
+    static_assert((N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+    public:
+        // producer side
+        bool push(const T& item) {
+            uint16_t head = head_count.load(std::memory_order_relaxed);
+            if ((uint16_t)(head - tail_count.load(std::memory_order_acquire)) >= N)
+                return false;
+            items[head & (N - 1)] = item;
+            head_count.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        // consumer side
+        bool pop(T& item) {
+            uint16_t tail = tail_count.load(std::memory_order_relaxed);
+            if (tail == head_count.load(std::memory_order_acquire))
+                return false;
+            item = items[tail & (N - 1)];
+            tail_count.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        T items[N];
+        std::atomic<uint16_t> head_count { 0 };
+        std::atomic<uint16_t> tail_count { 0 };
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+/*
+ Lock-free triple buffer for handing whole objects from one writer thread to one reader thread.
+ The writer fills the back buffer and publishes it, the reader picks up the latest published
+ buffer with a single atomic exchange. Neither side ever waits or copies, and the reader can
+ keep using its front buffer for as long as it likes.
+*/
+
+template <class T>
+class TripleBuffer {
+    public:
+        TripleBuffer() : shared { 1 } {}
+
+        // writer side: fill back(), then publish() it
+        T& back() {
+            return buffers[back_index];
+        }
+
+        void publish() {
+            back_index = shared.exchange(back_index | DIRTY, std::memory_order_acq_rel) & INDEX_MASK;
+        }
+
+        // reader side: true if update() would pick up a newly published buffer, front() is still the old one
+        bool pending() {
+            return shared.load(std::memory_order_relaxed) & DIRTY;
+        }
+
+        // reader side: returns true if a newly published buffer became front()
+        bool update() {
+            if (!(shared.load(std::memory_order_relaxed) & DIRTY))
+                return false;
+            front_index = shared.exchange(front_index, std::memory_order_acq_rel) & INDEX_MASK;
+            return true;
+        }
+
+        T& front() {
+            return buffers[front_index];
+        }
+
+    private:
+        static const uint8_t DIRTY = 0x80;
+        static const uint8_t INDEX_MASK = 0x03;
+
+        T buffers[3];
+        uint8_t front_index = 0;
+        uint8_t back_index = 2;
+        std::atomic<uint8_t> shared;
+};